@@ -0,0 +1,102 @@
+#include <cpp/json.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+// Workloads that copy Json values rather than parse them, where every copy
+// takes a reference and every destructor drops one. Built twice, with
+// atomic reference counts (bench_copy) and with plain ones
+// (bench_copy_plain, b2 refcount=plain).
+
+static std::string make_records(int count) {
+    std::string doc = "[";
+    char buf[256];
+    for (int i = 0; i < count; ++i) {
+        snprintf(buf, sizeof buf,
+                 "%s{\"id\":%d,\"name\":\"user number %d\",\"tags\":[\"a\",\"b\"],\"address\":{\"city\":\"Delft\"}}",
+                 i ? "," : "", i, i);
+        doc += buf;
+    }
+    doc += "]";
+    return doc;
+}
+
+template <class F>
+static double best_of(int rounds, F f) {
+    double best = 1e30;
+    for (int r = 0; r < rounds; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto stop = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(stop - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    const int count = argc > 1 ? atoi(argv[1]) : 100000;
+    const int rounds = argc > 2 ? atoi(argv[2]) : 10;
+
+    std::string err;
+    const xusd::Json records = xusd::Json::parse(make_records(count), err);
+    if (!err.empty() || records.array_items().size() != (size_t)count) {
+        fprintf(stderr, "parse failed: %s\n", err.c_str());
+        return 1;
+    }
+
+    volatile size_t sink = 0;
+    // Iteration by value, a copy of every record.
+    const double iterate = best_of(rounds, [&] {
+        size_t found = 0;
+        for (xusd::Json record : records.array_items())
+            found += record.is_object();
+        sink = found;
+    });
+    // Every member of every record copied out and dropped again.
+    const double members = best_of(rounds, [&] {
+        size_t found = 0;
+        for (const xusd::Json &record : records.array_items()) {
+            xusd::Json::object copy = record.object_items();
+            found += copy.size();
+        }
+        sink = found;
+    });
+    // The implicit constructors from standard containers.
+    const double containers = best_of(rounds, [&] {
+        std::vector<xusd::Json> names;
+        std::map<std::string, xusd::Json> by_name;
+        names.reserve(count);
+        for (const xusd::Json &record : records.array_items()) {
+            names.push_back(record["name"]);
+            by_name.emplace(record["name"].string_value(), record["address"]);
+        }
+        xusd::Json out = xusd::Json::object { { "names", names }, { "by_name", by_name } };
+        sink = out.object_items().size();
+    });
+    // Changes to copies of a shared document, each copying the path.
+    const double update = best_of(rounds, [&] {
+        size_t found = 0;
+        for (int i = 0; i < 100; ++i) {
+            xusd::Json changed = records;
+            changed[i]["address"]["city"] = "Leiden";
+            found += changed.array_items().size();
+        }
+        sink = found;
+    });
+    (void)sink;
+
+#ifdef JSON_CONF_PLAIN_REFCOUNT
+    printf("%d records, plain reference counts\n", count);
+#else
+    printf("%d records, atomic reference counts\n", count);
+#endif
+    printf("    iterate by value  %8.2f ns/record\n", iterate * 1e9 / count);
+    printf("    copy members      %8.2f ns/record\n", members * 1e9 / count);
+    printf("    from containers   %8.2f ns/record\n", containers * 1e9 / count);
+    printf("    update copy       %8.2f us/update\n", update * 1e6 / 100);
+    return 0;
+}
@@ -0,0 +1,170 @@
+#include <cpp/json.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+#include <string>
+
+// Json::parse() against JsonDocument::parse(): parse time, the memory the
+// result takes and walking all of it.
+
+// Every operator new and the bytes still allocated. Each block starts with
+// its size.
+static size_t allocations = 0;
+static size_t allocated = 0;
+
+void *operator new(size_t size) {
+    ++allocations;
+    allocated += size;
+    if (size_t *p = static_cast<size_t *>(malloc(size + 16))) {
+        *p = size;
+        return reinterpret_cast<char *>(p) + 16;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept {
+    if (p) {
+        size_t *block = reinterpret_cast<size_t *>(static_cast<char *>(p) - 16);
+        allocated -= *block;
+        free(block);
+    }
+}
+
+static std::string make_records(int count) {
+    std::string doc = "[";
+    char buf[512];
+    for (int i = 0; i < count; ++i) {
+        snprintf(buf, sizeof buf,
+                 "%s{\"id\":%d,\"name\":\"user%d\",\"email\":\"u%d@example.com\",\"active\":%s,"
+                 "\"score\":%d.5,\"tags\":[\"a\",\"b\",\"c\"],\"address\":{\"city\":\"Delft\",\"zip\":\"2611\"}}",
+                 i ? "," : "", i, i, i, (i % 2) ? "true" : "false", i % 100);
+        doc += buf;
+    }
+    doc += "]";
+    return doc;
+}
+
+static std::string make_numbers(int count) {
+    std::string doc = "[";
+    char buf[64];
+    unsigned int r = 12345;
+    for (int i = 0; i < count; ++i) {
+        r = r * 1103515245u + 12345u;
+        snprintf(buf, sizeof buf, "%s%u.%u", i ? "," : "", r >> 12, r & 0xff);
+        doc += buf;
+    }
+    doc += "]";
+    return doc;
+}
+
+template <class F>
+static double best_of(int rounds, F f) {
+    double best = 1e30;
+    for (int r = 0; r < rounds; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto stop = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(stop - start).count());
+    }
+    return best;
+}
+
+// The numbers and string bytes of a value and all values in it.
+static double walk(const xusd::Json &json) {
+    switch (json.type()) {
+        case xusd::Json::NUMBER: return json.number_value();
+        case xusd::Json::STRING: return json.string_view_value().size();
+        case xusd::Json::ARRAY: {
+            double sum = 0;
+            for (const xusd::Json &item : json.array_items())
+                sum += walk(item);
+            return sum;
+        }
+        case xusd::Json::OBJECT: {
+            double sum = 0;
+            for (const xusd::Json::object::value_type &member : json.object_items())
+                sum += walk(member.second);
+            return sum;
+        }
+        default: return 0;
+    }
+}
+
+static double walk(const xusd::JsonElement &element) {
+    switch (element.type()) {
+        case xusd::Json::NUMBER: return element.number_value();
+        case xusd::Json::STRING: return element.string_view_value().size();
+        case xusd::Json::ARRAY:
+        case xusd::Json::OBJECT: {
+            double sum = 0;
+            for (const xusd::JsonElement &item : element)
+                sum += walk(item);
+            return sum;
+        }
+        default: return 0;
+    }
+}
+
+static void run(const char *name, const std::string &doc, int rounds) {
+    std::string err;
+    size_t allocations_before = allocations;
+    size_t allocated_before = allocated;
+    const xusd::Json json = xusd::Json::parse(doc, err);
+    const size_t json_allocations = allocations - allocations_before;
+    const size_t json_bytes = allocated - allocated_before;
+
+    allocations_before = allocations;
+    allocated_before = allocated;
+    const xusd::JsonDocument tape = xusd::JsonDocument::parse(doc, err);
+    const size_t tape_allocations = allocations - allocations_before;
+    const size_t tape_bytes = allocated - allocated_before;
+    if (!err.empty() || walk(json) != walk(tape.root())) {
+        fprintf(stderr, "%s: parse failed: %s\n", name, err.c_str());
+        exit(1);
+    }
+
+    volatile double sink = 0;
+    const double json_parse = best_of(rounds, [&] {
+        xusd::Json parsed = xusd::Json::parse(doc, err);
+        sink = parsed.is_array();
+    });
+    const double tape_parse = best_of(rounds, [&] {
+        xusd::JsonDocument parsed = xusd::JsonDocument::parse(doc, err);
+        sink = parsed.root().is_array();
+    });
+    const double json_walk = best_of(rounds, [&] { sink = walk(json); });
+    const double tape_walk = best_of(rounds, [&] { sink = walk(tape.root()); });
+    const double json_lookup = best_of(rounds, [&] {
+        double sum = 0;
+        for (const xusd::Json &item : json.array_items())
+            sum += item["score"].number_value();
+        sink = sum;
+    });
+    const double tape_lookup = best_of(rounds, [&] {
+        double sum = 0;
+        for (const xusd::JsonElement &item : tape.root())
+            sum += item["score"].number_value();
+        sink = sum;
+    });
+    const double to_json = best_of(rounds, [&] { sink = tape.to_json().is_array(); });
+    (void)sink;
+
+    const double mb = doc.size() / (1024.0 * 1024.0);
+    printf("%s, %.1f MB\n", name, mb);
+    printf("                   %12s %12s\n", "Json", "JsonDocument");
+    printf("    parse MB/s     %12.1f %12.1f\n", mb / json_parse, mb / tape_parse);
+    printf("    bytes/input    %12.2f %12.2f\n", (double)json_bytes / doc.size(), (double)tape_bytes / doc.size());
+    printf("    allocations    %12zu %12zu\n", json_allocations, tape_allocations);
+    printf("    walk ms        %12.2f %12.2f\n", json_walk * 1e3, tape_walk * 1e3);
+    printf("    [\"score\"] ms   %12.2f %12.2f\n", json_lookup * 1e3, tape_lookup * 1e3);
+    printf("    to_json() ms   %12s %12.2f\n", "", to_json * 1e3);
+}
+
+int main(int argc, char* argv[]) {
+    const int count = argc > 1 ? atoi(argv[1]) : 100000;
+    const int rounds = argc > 2 ? atoi(argv[2]) : 10;
+    run("records", make_records(count), rounds);
+    run("numbers", make_numbers(count * 10), rounds);
+    return 0;
+}
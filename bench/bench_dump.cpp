@@ -0,0 +1,122 @@
+#include <cpp/json.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <string>
+
+// Json::dump() of a document made mostly of doubles, a GeoJSON feature
+// collection of polygons with coordinates given to seven decimals as GPS
+// data usually is, and of one made mostly of strings, forwarded log
+// records with the odd quote and stack trace.
+
+static xusd::Json make_features(int count) {
+    unsigned int r = 12345;
+    auto coordinate = [&r](double low, double range) {
+        r = r * 1103515245u + 12345u;
+        return std::round((low + range * (r >> 8) / 16777216.0) * 1e7) / 1e7;
+    };
+    xusd::Json::array features;
+    features.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        const double lon = coordinate(-180, 360), lat = coordinate(-80, 160);
+        xusd::Json::array ring;
+        for (int j = 0; j < 16; ++j)
+            ring.push_back(xusd::Json::array { lon + coordinate(0, 0.01), lat + coordinate(0, 0.01) });
+        ring.push_back(ring.front());
+        features.push_back(xusd::Json::object {
+            { "type", "Feature" },
+            { "properties", xusd::Json::object { { "id", i }, { "area", coordinate(0, 1000) } } },
+            { "geometry", xusd::Json::object {
+                { "type", "Polygon" },
+                { "coordinates", xusd::Json::array { ring } },
+            } },
+        });
+    }
+    return xusd::Json::object { { "type", "FeatureCollection" }, { "features", features } };
+}
+
+static xusd::Json make_logs(int count) {
+    static const char *const messages[] = {
+        "GET /api/v2/users/8812/orders?page=3&limit=50 HTTP/1.1 200 1843 bytes in 12 ms from 10.0.4.17",
+        "cache miss for key session:3f9c1a7e-52b1-4c1e-9a43-0d7f2c9b11e4, fetching from the primary store",
+        "request rejected: header \"X-Request-Id\" is missing, client library is probably out of date",
+        "worker 7 failed: java.lang.IllegalStateException: queue closed\n\tat Queue.put(Queue.java:88)\n"
+        "\tat Worker.run(Worker.java:41)",
+    };
+    xusd::Json::array logs;
+    logs.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        logs.push_back(xusd::Json::object {
+            { "ts", "2024-05-17T09:12:44.123Z" },
+            { "level", i % 16 ? "info" : "error" },
+            { "host", "api-eu-west-1-7f9c" },
+            { "msg", messages[i % 16 ? i % 3 : 3] },
+        });
+    }
+    return logs;
+}
+
+template <class F>
+static double best_of(int rounds, F f) {
+    double best = 1e30;
+    for (int r = 0; r < rounds; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto stop = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(stop - start).count());
+    }
+    return best;
+}
+
+static void run(const char *name, xusd::Json (*make)(int), int count, int rounds) {
+    // The first dump scans every string for characters to escape, later
+    // ones find their sizes in the nodes.
+    const xusd::Json json = make(count);
+    std::string out;
+    const double first = best_of(1, [&] { json.dump(out); });
+    std::string err;
+    if (xusd::Json::parse(out, err) != json || json.dump_size() != out.size()) {
+        fprintf(stderr, "%s: dump does not read back: %s\n", name, err.c_str());
+        exit(1);
+    }
+
+    volatile size_t sink = 0;
+    const double dump = best_of(rounds, [&] {
+        std::string text;
+        json.dump(text);
+        sink = text.size();
+    });
+    // The same through the fixed buffer of dump_to(), to a sink that
+    // drops it.
+    const double stream = best_of(rounds, [&] {
+        size_t size = 0;
+        json.dump_to([&size](const char *, size_t n) {
+            size += n;
+            return true;
+        });
+        sink = size;
+    });
+    (void)sink;
+
+    const double mb = out.size() / (1024.0 * 1024.0);
+    printf("%s\n", name);
+    printf("    output bytes   %12zu\n", out.size());
+    printf("    dump MB/s      %12.1f\n", mb / dump);
+    printf("    dump ms        %12.2f\n", dump * 1e3);
+    printf("    dump_to MB/s   %12.1f\n", mb / stream);
+    printf("    first dump ms  %12.2f\n", first * 1e3);
+}
+
+static xusd::Json make_more_logs(int count) {
+    return make_logs(count * 5);
+}
+
+int main(int argc, char* argv[]) {
+    const int count = argc > 1 ? atoi(argv[1]) : 20000;
+    const int rounds = argc > 2 ? atoi(argv[2]) : 10;
+    run("geojson", make_features, count, rounds);
+    run("logs", make_more_logs, count, rounds);
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include <c/json.h>
+#include <cpp/json.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Every operator new, to report the allocations per parsed document.
+static size_t allocations = 0;
+
+void *operator new(size_t size) {
+    ++allocations;
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+// A pretty printed array of log-like records, roughly `records` * 330 bytes.
+static std::string make_document(int records) {
+    std::string doc = "[\n";
+    char buf[512];
+    for (int i = 0; i < records; ++i) {
+        snprintf(buf, sizeof buf,
+                 "    {\n"
+                 "        \"id\": %d,\n"
+                 "        \"level\": \"%s\",\n"
+                 "        \"latency\": %d.%03d,\n"
+                 "        \"ok\": %s,\n"
+                 "        \"tags\": [\"api\", \"v2\", \"region-%d\"],\n"
+                 "        \"message\": \"request %d served from cache \\\"hot\\\" after %d retries, payload aGVsbG8gd29ybGQ=\",\n"
+                 "        \"parent\": null\n"
+                 "    }%s\n",
+                 i, (i % 7) ? "info" : "warn", i % 997, i % 1000, (i % 3) ? "true" : "false",
+                 i % 16, i, i % 5, i + 1 < records ? "," : "");
+        doc += buf;
+    }
+    doc += "]\n";
+    return doc;
+}
+
+// A GeoJSON-like polygon, `points` coordinate pairs of about 40 bytes each.
+static std::string make_coordinates(int points) {
+    std::string doc = "{\"type\":\"Polygon\",\"coordinates\":[[";
+    char buf[64];
+    unsigned int r = 12345;
+    for (int i = 0; i < points; ++i) {
+        r = r * 1103515245u + 12345u;
+        snprintf(buf, sizeof buf, "%s[%.14f,%.14f]", i ? "," : "",
+                 -180.0 + (r >> 8) % 3600000 / 10000.0 + i * 1e-9,
+                 -90.0 + (r >> 4) % 1800000 / 10000.0 + i * 1e-9);
+        doc += buf;
+    }
+    doc += "]]}";
+    return doc;
+}
+
+// Best wall time of `rounds` rounds of parsing `doc` repeatedly (about 8 MB
+// per round, so small messages are measurable), in seconds per byte. In situ
+// parses a fresh copy of the document each time, the copy is timed too.
+// Borrowed parses share one copy of the document.
+enum Mode { COPY, INSITU, BORROWED };
+
+struct Result {
+    double bytes_per_second;
+    size_t allocations;
+};
+
+// Best wall time of `rounds` rounds of parsing `doc` repeatedly (about 8 MB
+// per round, so small messages are measurable), and the allocations of one
+// parse. In situ parses a fresh copy of the document each time, the copy is
+// timed too. Borrowed parses share one copy of the document.
+static Result time_parse(const std::string &doc, int options, Mode mode, int rounds) {
+    const int repeat = std::max<size_t>(1, (8u << 20) / doc.size());
+    std::vector<char> buffer(doc.size() + 1);
+    std::shared_ptr<const std::string> shared = std::make_shared<std::string>(doc);
+    double best = 1e30;
+    size_t before = 0, after = 0;
+    for (int r = 0; r < rounds; ++r) {
+        std::string err;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeat; ++i) {
+            xusd::Json json;
+            before = allocations;
+            if (mode == INSITU) {
+                memcpy(buffer.data(), doc.c_str(), doc.size() + 1);
+                json = xusd::Json::parse_insitu(buffer.data(), err, options);
+            } else if (mode == BORROWED) {
+                json = xusd::Json::parse_borrowed(shared, err, options);
+            } else {
+                json = xusd::Json::parse(doc, err, options);
+            }
+            after = allocations;
+            if (!err.empty() || json.is_null()) {
+                fprintf(stderr, "parse failed: %s\n", err.c_str());
+                exit(1);
+            }
+        }
+        auto stop = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(stop - start).count() / repeat);
+    }
+    return Result { doc.size() / best, after - before };
+}
+
+static void report(const char *name, const std::string &doc, int rounds) {
+    static const struct {
+        const char *name;
+        int options;
+        Mode mode;
+    } modes[] = {
+        { "tokenizer", xusd::Json::PARSE_DEFAULT, COPY },
+        { "structural index", xusd::Json::PARSE_STRUCTURAL_INDEX, COPY },
+        { "in situ", xusd::Json::PARSE_DEFAULT, INSITU },
+        { "borrowed", xusd::Json::PARSE_DEFAULT, BORROWED },
+        { "arena", xusd::Json::PARSE_ARENA, COPY },
+        { "arena, index", xusd::Json::PARSE_ARENA | xusd::Json::PARSE_STRUCTURAL_INDEX, COPY },
+    };
+    printf("%s, %zu bytes\n", name, doc.size());
+    for (auto &m : modes) {
+        Result result = time_parse(doc, m.options, m.mode, rounds);
+        printf("    %-18s %8.1f MB/s %10zu allocations\n",
+               m.name, result.bytes_per_second / (1024.0 * 1024.0), result.allocations);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const int records = argc > 1 ? atoi(argv[1]) : 20000;
+    const int rounds = argc > 2 ? atoi(argv[2]) : 10;
+
+    printf("offsets: %d bit\n", (int)sizeof(jsonparse_offset_t) * 8);
+    report("small message", make_document(1), rounds);
+    report("large document", make_document(records), rounds);
+    report("coordinates", make_coordinates(records * 8), rounds);
+    return 0;
+}
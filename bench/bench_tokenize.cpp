@@ -0,0 +1,40 @@
+#include <c/jsonparse.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Typical small-object messages: mixed keys, strings, numbers, literals and
+// a little nesting.
+static const char *messages[] = {
+    R"({"id":1842,"user":"alice","active":true,"score":97.5,"tags":["a","b"],"ref":null})",
+    R"({"op":"set","key":"cfg/timeout","value":30,"ttl":-1,"meta":{"src":"api","v":2}})",
+    R"({"ts":1700000000123,"level":"info","msg":"ok","ctx":{"req":"7f3a","ms":12},"err":false})",
+    R"([{"x":1,"y":2},{"x":3,"y":4},{"x":5,"y":6},{"x":7,"y":8}])",
+};
+
+int main(int argc, char* argv[]) {
+    const int rounds = argc > 1 ? atoi(argv[1]) : 10;
+    const int repeat = 200000;
+    const int n = sizeof(messages) / sizeof(messages[0]);
+    double best = 1e30;
+    long tokens = 0;
+
+    for (int r = 0; r < rounds; ++r) {
+        tokens = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeat; ++i) {
+            const char *json = messages[i % n];
+            struct jsonparse_state state;
+            jsonparse_setup(&state, json, strlen(json));
+            while (jsonparse_next(&state) != JSON_TYPE_ERROR) {
+                tokens++;
+            }
+        }
+        auto stop = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(stop - start).count());
+    }
+    printf("%ld tokens, %.1f M tokens/s\n", tokens, tokens / best / 1e6);
+    return 0;
+}
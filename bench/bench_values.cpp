@@ -0,0 +1,323 @@
+#include <cpp/json.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <new>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Every operator new and the bytes still allocated, to report the memory
+// a tree takes. Each block starts with its size.
+static size_t allocations = 0;
+static size_t allocated = 0;
+
+void *operator new(size_t size) {
+    ++allocations;
+    allocated += size;
+    if (size_t *p = static_cast<size_t *>(malloc(size + 16))) {
+        *p = size;
+        return reinterpret_cast<char *>(p) + 16;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept {
+    if (p) {
+        size_t *block = reinterpret_cast<size_t *>(static_cast<char *>(p) - 16);
+        allocated -= *block;
+        free(block);
+    }
+}
+
+// An array of `count` numbers, integers and doubles alternating.
+static std::string make_numbers(int count) {
+    std::string doc = "[";
+    char buf[64];
+    unsigned int r = 12345;
+    for (int i = 0; i < count; ++i) {
+        r = r * 1103515245u + 12345u;
+        if (i % 2)
+            snprintf(buf, sizeof buf, "%s%.6f", i ? "," : "", (r >> 8) / 1000.0);
+        else
+            snprintf(buf, sizeof buf, "%s%u", i ? "," : "", r >> 4);
+        doc += buf;
+    }
+    doc += "]";
+    return doc;
+}
+
+// An array of `count` records with 12 members each.
+static const char *const record_keys[] = {
+    "id", "name", "email", "active", "score", "created_at",
+    "updated_at", "country", "city", "zip", "tags", "parent",
+};
+
+static std::string make_record(int i) {
+    char buf[512];
+    snprintf(buf, sizeof buf,
+             "{\"id\":%d,\"name\":\"user%d\",\"email\":\"u%d@example.com\",\"active\":%s,"
+             "\"score\":%d.5,\"created_at\":%d,\"updated_at\":%d,\"country\":\"NL\","
+             "\"city\":\"Delft\",\"zip\":\"2611\",\"tags\":[],\"parent\":null}",
+             i, i, i, (i % 2) ? "true" : "false", i % 100, 1700000000 + i, 1700000000 + 2 * i);
+    return buf;
+}
+
+static std::string make_records(int count) {
+    std::string doc = "[";
+    for (int i = 0; i < count; ++i) {
+        if (i)
+            doc += ",";
+        doc += make_record(i);
+    }
+    doc += "]";
+    return doc;
+}
+
+// A log event with keys longer than the 15 bytes kept inline.
+static std::string make_event(int i) {
+    char buf[512];
+    snprintf(buf, sizeof buf,
+             "{\"timestamp\":%d,\"request_duration_ms\":%d,\"upstream_response_time\":%d.%03d,"
+             "\"http_status_code\":%d,\"http_request_method\":\"GET\",\"remote_address\":\"10.0.%d.%d\","
+             "\"response_body_bytes\":%d,\"cache_status\":\"HIT\"}",
+             1700000000 + i, i % 250, i % 3, i % 1000, (i % 20) ? 200 : 404, i % 256, i % 199, i * 7 % 65536);
+    return buf;
+}
+
+// An array of `count` rows of short strings: statuses, codes and flags,
+// and one short id that is unique.
+static std::string make_short_strings(int count) {
+    static const char *const statuses[] = { "active", "pending", "closed", "failed" };
+    static const char *const countries[] = { "NL", "DE", "US", "FR", "JP", "BR" };
+    std::string doc = "[";
+    char buf[256];
+    for (int i = 0; i < count; ++i) {
+        snprintf(buf, sizeof buf,
+                 "%s{\"status\":\"%s\",\"country\":\"%s\",\"currency\":\"%s\",\"flag\":\"%s\","
+                 "\"level\":\"%s\",\"id\":\"u%07d\"}",
+                 i ? "," : "", statuses[i % 4], countries[i % 6], (i % 3) ? "EUR" : "USD",
+                 (i % 2) ? "Y" : "N", (i % 10) ? "info" : "warn", i);
+        doc += buf;
+    }
+    doc += "]";
+    return doc;
+}
+
+// An array of `count` rows whose values are mostly empty or small.
+static std::string make_sparse(int count) {
+    std::string doc = "[";
+    char buf[256];
+    for (int i = 0; i < count; ++i) {
+        snprintf(buf, sizeof buf,
+                 "%s{\"note\":\"\",\"tags\":[],\"meta\":{},\"count\":%d,\"flags\":[0,1,-1],\"extra\":{}}",
+                 i ? "," : "", i % 3 - 1);
+        doc += buf;
+    }
+    doc += "]";
+    return doc;
+}
+
+// Parse every line on its own, like NDJSON, and keep the documents.
+struct LinesResult {
+    double seconds;
+    size_t bytes;
+    size_t allocations;
+};
+
+static LinesResult parse_lines(const std::vector<std::string> &lines, int options) {
+    std::vector<xusd::Json> parsed(lines.size());
+    std::string err;
+    const size_t allocations_before = allocations;
+    const size_t allocated_before = allocated;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lines.size(); ++i)
+        parsed[i] = xusd::Json::parse(lines[i], err, options);
+    auto stop = std::chrono::steady_clock::now();
+    return LinesResult { std::chrono::duration<double>(stop - start).count(),
+                         allocated - allocated_before, allocations - allocations_before };
+}
+
+// One object mapping `count` ids to small records, in random order.
+static std::string make_dictionary(int count) {
+    std::string doc = "{";
+    char buf[128];
+    for (int i = 0; i < count; ++i) {
+        const int id = (int)((i * 2654435761u) % (unsigned)count);
+        snprintf(buf, sizeof buf, "%s\"user-%08d\":{\"n\":%d}", i ? "," : "", id, id);
+        doc += buf;
+    }
+    doc += "}";
+    return doc;
+}
+
+template <class F>
+static double best_of(int rounds, F f) {
+    double best = 1e30;
+    for (int r = 0; r < rounds; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto stop = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double>(stop - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    const int count = argc > 1 ? atoi(argv[1]) : 1000000;
+    const int rounds = argc > 2 ? atoi(argv[2]) : 10;
+
+    const std::string doc = make_numbers(count);
+    std::string err;
+    const size_t allocations_before = allocations;
+    const size_t allocated_before = allocated;
+    const xusd::Json json = xusd::Json::parse(doc, err);
+    if (!err.empty() || json.array_items().size() != (size_t)count) {
+        fprintf(stderr, "parse failed: %s\n", err.c_str());
+        return 1;
+    }
+    const size_t tree_allocations = allocations - allocations_before;
+    const size_t tree_bytes = allocated - allocated_before;
+
+    volatile double sink = 0;
+    const double iterate = best_of(rounds, [&] {
+        double sum = 0;
+        for (const xusd::Json &value : json.array_items())
+            sum += value.number_value();
+        sink = sum;
+    });
+    const double index = best_of(rounds, [&] {
+        double sum = 0;
+        for (int i = 0; i < count; ++i)
+            if (json[i].is_number())
+                sum += json[i].number_value();
+        sink = sum;
+    });
+    const double copy = best_of(rounds, [&] {
+        xusd::Json::array items = json.array_items();
+        sink = items.size();
+    });
+    const double parse = best_of(rounds, [&] {
+        xusd::Json parsed = xusd::Json::parse(doc, err);
+        sink = parsed.array_items().size();
+    });
+
+    const int record_count = count / 10;
+    const std::string records_doc = make_records(record_count);
+    const size_t objects_allocations_before = allocations;
+    const size_t objects_allocated_before = allocated;
+    const xusd::Json records = xusd::Json::parse(records_doc, err);
+    if (!err.empty()) {
+        fprintf(stderr, "parse failed: %s\n", err.c_str());
+        return 1;
+    }
+    const size_t objects_allocations = allocations - objects_allocations_before;
+    const size_t objects_bytes = allocated - objects_allocated_before;
+    std::vector<std::string> keys(std::begin(record_keys), std::end(record_keys));
+    const double lookup = best_of(rounds, [&] {
+        size_t found = 0;
+        for (const xusd::Json &record : records.array_items())
+            for (const std::string &key : keys)
+                found += !record[key].is_null();
+        sink = found;
+    });
+    const double parse_records = best_of(rounds, [&] {
+        xusd::Json parsed = xusd::Json::parse(records_doc, err);
+        sink = parsed.array_items().size();
+    });
+    // One member changed in a copy: copies the array and one record.
+    const double update = best_of(rounds, [&] {
+        xusd::Json changed = records;
+        changed[record_count / 2]["score"] = 1;
+        sink = changed.array_items().size();
+    });
+
+    std::vector<std::string> lines;
+    for (int i = 0; i < record_count; ++i)
+        lines.push_back(make_event(i));
+    LinesResult lines_default = parse_lines(lines, xusd::Json::PARSE_DEFAULT);
+    LinesResult lines_interned = parse_lines(lines, xusd::Json::PARSE_INTERN_KEYS);
+    for (int r = 1; r < rounds; ++r) {
+        lines_default.seconds = std::min(lines_default.seconds,
+                                         parse_lines(lines, xusd::Json::PARSE_DEFAULT).seconds);
+        lines_interned.seconds = std::min(lines_interned.seconds,
+                                          parse_lines(lines, xusd::Json::PARSE_INTERN_KEYS).seconds);
+    }
+
+    const std::string short_doc = make_short_strings(record_count);
+    const size_t short_allocations_before = allocations;
+    const size_t short_allocated_before = allocated;
+    const xusd::Json short_strings = xusd::Json::parse(short_doc, err);
+    const size_t short_allocations = allocations - short_allocations_before;
+    const size_t short_bytes = allocated - short_allocated_before;
+    const double parse_short = best_of(rounds, [&] {
+        xusd::Json parsed = xusd::Json::parse(short_doc, err);
+        sink = parsed.array_items().size();
+    });
+
+    const std::string sparse_doc = make_sparse(record_count);
+    const size_t sparse_allocations_before = allocations;
+    const size_t sparse_allocated_before = allocated;
+    const xusd::Json sparse = xusd::Json::parse(sparse_doc, err);
+    const size_t sparse_allocations = allocations - sparse_allocations_before;
+    const size_t sparse_bytes = allocated - sparse_allocated_before;
+    const double parse_sparse = best_of(rounds, [&] {
+        xusd::Json parsed = xusd::Json::parse(sparse_doc, err);
+        sink = parsed.array_items().size();
+    });
+
+    const int dictionary_count = count / 10;
+    const std::string dictionary_doc = make_dictionary(dictionary_count);
+    const xusd::Json dictionary = xusd::Json::parse(dictionary_doc, err);
+    std::vector<std::string> ids;
+    for (int i = 0; i < dictionary_count; ++i) {
+        char id[32];
+        snprintf(id, sizeof id, "user-%08d", (int)((i * 40503u) % (unsigned)dictionary_count));
+        ids.push_back(id);
+    }
+    const double dictionary_lookup = best_of(rounds, [&] {
+        size_t found = 0;
+        for (const std::string &id : ids)
+            found += dictionary[id]["n"].is_number();
+        sink = found;
+    });
+    const double dictionary_parse = best_of(rounds, [&] {
+        xusd::Json parsed = xusd::Json::parse(dictionary_doc, err);
+        sink = parsed.object_items().size();
+    });
+    (void)sink;
+
+    printf("%d numbers, sizeof(Json) %zu\n", count, sizeof(xusd::Json));
+    printf("    tree         %8.1f bytes/number %10zu allocations\n",
+           (double)tree_bytes / count, tree_allocations);
+    printf("    iterate      %8.2f ns/number\n", iterate * 1e9 / count);
+    printf("    operator[]   %8.2f ns/number\n", index * 1e9 / count);
+    printf("    copy items   %8.2f ns/number\n", copy * 1e9 / count);
+    printf("    parse        %8.2f ns/number\n", parse * 1e9 / count);
+    printf("%d objects of 12 members\n", record_count);
+    printf("    tree         %8.1f bytes/object %10zu allocations\n",
+           (double)objects_bytes / record_count, objects_allocations);
+    printf("    lookup       %8.2f ns/member\n", lookup * 1e9 / (record_count * keys.size()));
+    printf("    parse        %8.2f ns/object\n", parse_records * 1e9 / record_count);
+    printf("    update copy  %8.2f us\n", update * 1e6);
+    printf("%d rows of 6 short strings\n", record_count);
+    printf("    tree         %8.1f bytes/row    %10zu allocations\n",
+           (double)short_bytes / record_count, short_allocations);
+    printf("    parse        %8.2f ns/row (%.1f MB/s)\n", parse_short * 1e9 / record_count,
+           short_doc.size() / parse_short / (1024.0 * 1024.0));
+    printf("%d rows of empty and small values\n", record_count);
+    printf("    tree         %8.1f bytes/row    %10zu allocations\n",
+           (double)sparse_bytes / record_count, sparse_allocations);
+    printf("    parse        %8.2f ns/row\n", parse_sparse * 1e9 / record_count);
+    printf("%d events of 8 members parsed one by one\n", record_count);
+    printf("    default      %8.1f bytes/event %10zu allocations %8.2f ns/event\n",
+           (double)lines_default.bytes / record_count, lines_default.allocations,
+           lines_default.seconds * 1e9 / record_count);
+    printf("    interned     %8.1f bytes/event %10zu allocations %8.2f ns/event\n",
+           (double)lines_interned.bytes / record_count, lines_interned.allocations,
+           lines_interned.seconds * 1e9 / record_count);
+    printf("1 object of %d members\n", dictionary_count);
+    printf("    lookup       %8.2f ns/member\n", dictionary_lookup * 1e9 / dictionary_count);
+    printf("    parse        %8.2f ns/member\n", dictionary_parse * 1e9 / dictionary_count);
+    return 0;
+}
@@ -4,6 +4,10 @@
 
 #ifndef INCLUDE_C_JSON_H_
 #define INCLUDE_C_JSON_H_
+
+#include <limits.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -37,6 +41,16 @@ enum {
 #define JSON_CONTENT_TYPE "application/json"
 #define JSONPARSE_MAX_DEPTH 256
 
+/* offsets into the parsed text; documents of 2 GiB and more need
+   JSONPARSE_CONF_LARGE_DOCUMENTS, which doubles the size of every offset */
+#ifdef JSONPARSE_CONF_LARGE_DOCUMENTS
+typedef int64_t jsonparse_offset_t;
+#define JSONPARSE_MAX_LEN INT64_MAX
+#else
+typedef int jsonparse_offset_t;
+#define JSONPARSE_MAX_LEN INT_MAX
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,68 @@
+/**
+ * Structural index of a JSON text: the offsets of every character the
+ * parser has to stop at, found with vector instructions in one pass.
+ */
+
+#ifndef INCLUDE_C_JSONINDEX_H_
+#define INCLUDE_C_JSONINDEX_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "./json.h"
+
+/* smallest window jsonindex_next() accepts, one block of input */
+#define JSONINDEX_BLOCK 64
+
+struct jsonindex_state {
+    const char *json;
+    jsonparse_offset_t len;
+    jsonparse_offset_t pos;
+    /* carried from one block to the next */
+    uint64_t prev_escaped;
+    uint64_t prev_in_string;
+    uint64_t prev_scalar;
+};
+
+/**
+ * \brief      Initialize a structural indexer.
+ * \param state A pointer to an indexer state
+ * \param json  The string to index
+ * \param len   The length of the string
+ */
+void jsonindex_setup(struct jsonindex_state *state, const char *json, jsonparse_offset_t len);
+
+/**
+ * \brief      Index the next part of the text.
+ * \param state A pointer to an indexer state
+ * \param index Receives the offsets
+ * \param size  Room in index, at least JSONINDEX_BLOCK
+ * \return     The number of offsets written, 0 once the whole text is
+ *             indexed, or -1 if the text ends inside a string
+ *
+ *             Recorded are the offsets of '{', '}', '[', ']', ':' and ','
+ *             outside of strings, of every quote that is not escaped (the
+ *             opening quote of a string is always directly followed by its
+ *             closing quote in the index) and of the first character of
+ *             every number or literal. Indexing a large text window by
+ *             window keeps the memory bounded.
+ */
+jsonparse_offset_t jsonindex_next(struct jsonindex_state *state, jsonparse_offset_t *index,
+                                  jsonparse_offset_t size);
+
+/**
+ * \brief      Build the structural index of a whole JSON text.
+ * \param json  The string to index
+ * \param len   The length of the string
+ * \param index Receives the offsets, must have room for len entries
+ * \return     The number of offsets written, or -1 if the text ends
+ *             inside a string
+ */
+jsonparse_offset_t jsonindex_build(const char *json, jsonparse_offset_t len,
+                                   jsonparse_offset_t *index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // INCLUDE_C_JSONINDEX_H_
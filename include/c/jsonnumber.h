@@ -0,0 +1,93 @@
+/**
+ * Exact, locale-independent conversion of JSON number tokens.
+ */
+
+#ifndef INCLUDE_C_JSONNUMBER_H_
+#define INCLUDE_C_JSONNUMBER_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "./json.h"
+
+struct jsonnumber {
+    /* the token correctly rounded to the nearest double */
+    double value;
+    /* magnitude of the token, exact if integer is set */
+    uint64_t mantissa;
+    char negative;
+    /* no fraction or exponent and the magnitude fits into mantissa */
+    char integer;
+};
+
+/**
+ * \brief      Convert a JSON number.
+ * \param json The text starting with the number
+ * \param len  The number of bytes that may be read
+ * \param num  Receives the value of the number
+ * \return     The length of the number, or 0 if the text does not start
+ *             with a number of the JSON grammar
+ *
+ *             Conversion is done in one pass over the digits and does
+ *             not depend on the current locale. The text does not need
+ *             to be terminated.
+ */
+jsonparse_offset_t jsonnumber_parse(const char *json, jsonparse_offset_t len, struct jsonnumber *num);
+
+/* the most bytes jsonnumber_format() writes */
+#define JSONNUMBER_FORMAT_MAX 25
+
+/**
+ * \brief       Write a short JSON number that reads back as a double.
+ * \param value The number to write
+ * \param buf   Receives the number, room for JSONNUMBER_FORMAT_MAX bytes
+ * \return      The length of the number, not terminated, or 0 if value is
+ *              infinite or not a number
+ *
+ *              The number converts back to exactly value. Its digits are
+ *              the fewest that do for all but about one in a thousand
+ *              values, which get one more. The layout is that of
+ *              ECMAScript: 0.1, 100, 1e+21, 1.5e-7. Does not depend on
+ *              the current locale. Only the bytes of the number are
+ *              written.
+ */
+int jsonnumber_format(double value, char *buf);
+
+/* the most bytes the jsonnumber_format_*int*() functions write */
+#define JSONNUMBER_FORMAT_INT_MAX 20
+
+/**
+ * \brief       Write an integer in decimal.
+ * \param value The number to write
+ * \param buf   Receives the digits, room for JSONNUMBER_FORMAT_INT_MAX bytes
+ * \return      The length of the number, not terminated
+ *
+ *              The digits are counted first and written to their place
+ *              two at a time, without a format string or a buffer on the
+ *              way. Only the bytes of the number are written. The minimum
+ *              of each type is written correctly.
+ */
+int jsonnumber_format_int32(int32_t value, char *buf);
+int jsonnumber_format_int64(int64_t value, char *buf);
+int jsonnumber_format_uint64(uint64_t value, char *buf);
+
+/**
+ * \brief       The length jsonnumber_format() or the jsonnumber_format_*int*()
+ *              functions return for value, without writing it.
+ * \param value The number to measure
+ * \return      The length of the number, 0 for a double that is infinite or
+ *              not a number
+ *
+ *              Integers, and doubles that are whole numbers below 2^53, are
+ *              counted from their digits; other doubles still go through
+ *              Grisu2, but not through the layout.
+ */
+int jsonnumber_format_size(double value);
+int jsonnumber_format_int64_size(int64_t value);
+int jsonnumber_format_uint64_size(uint64_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // INCLUDE_C_JSONNUMBER_H_
@@ -10,12 +10,12 @@ extern "C" {
 
 struct jsonparse_state {
     const char *json;
-    int pos;
-    int len;
+    jsonparse_offset_t pos;
+    jsonparse_offset_t len;
     int depth;
     /* for handling atomic values */
-    int vstart;
-    int vlen;
+    jsonparse_offset_t vstart;
+    jsonparse_offset_t vlen;
     char vtype;
     char error;
     char stack[JSONPARSE_MAX_DEPTH];
@@ -30,7 +30,7 @@ struct jsonparse_state {
  *             This function initializes a JSON parser state for
  *             parsing a string as JSON.
  */
-void jsonparse_setup(struct jsonparse_state *state, const char *json, int len);
+void jsonparse_setup(struct jsonparse_state *state, const char *json, jsonparse_offset_t len);
 
 /* move to next JSON element */
 int jsonparse_next(struct jsonparse_state *state);
@@ -44,8 +44,26 @@ int jsonparse_get_value_as_int(struct jsonparse_state *state);
 /* get the current JSON value parsed as a long */
 long jsonparse_get_value_as_long(struct jsonparse_state *state);
 
+/* get the current JSON value parsed as a double, correctly rounded and
+   independent of the locale; 0 if it is not a valid number */
+double jsonparse_get_value_as_double(struct jsonparse_state *state);
+
+/**
+ * \brief      Decode the escapes of a string body.
+ * \param str  The body of the string, without the quotes
+ * \param len  The length of the body
+ * \param out  Receives the decoded string; may be str itself to decode
+ *             in place, the result is never longer than the input
+ * \return     The length of the decoded string, or -1 if the body has an
+ *             invalid escape
+ *
+ *             \uXXXX escapes are written as UTF-8, surrogate pairs are
+ *             combined into one code point.
+ */
+jsonparse_offset_t jsonparse_unescape(const char *str, jsonparse_offset_t len, char *out);
+
 /* get the length of the current JSON value */
-int jsonparse_get_len(struct jsonparse_state *state);
+jsonparse_offset_t jsonparse_get_len(struct jsonparse_state *state);
 
 /* get the type of the current JSON value */
 int jsonparse_get_type(struct jsonparse_state *state);
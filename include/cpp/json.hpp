@@ -1,13 +1,224 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iosfwd>
 #include <string>
 #include <vector>
-#include <map>
 #include <memory>
 #include <initializer_list>
+#include <type_traits>
 
 namespace xusd{
 class JsonValue;
+class KeyPool;
+class object_map;
+
+// A read-only view of characters owned by someone else; std::string_view
+// for C++11.
+class string_view final {
+public:
+    typedef const char * const_iterator;
+
+    string_view() noexcept : m_data(""), m_size(0) {}
+    string_view(const char * data, size_t size) noexcept : m_data(data), m_size(size) {}
+    string_view(const char * data) : m_data(data), m_size(std::char_traits<char>::length(data)) {}
+    string_view(const std::string & str) noexcept : m_data(str.data()), m_size(str.size()) {}
+
+    const char * data() const { return m_data; }
+    size_t size() const { return m_size; }
+    size_t length() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    const_iterator begin() const { return m_data; }
+    const_iterator end() const { return m_data + m_size; }
+    char operator[](size_t i) const { return m_data[i]; }
+
+    std::string to_string() const { return std::string(m_data, m_size); }
+    explicit operator std::string() const { return to_string(); }
+
+    int compare(string_view other) const {
+        int r = std::char_traits<char>::compare(m_data, other.m_data, std::min(m_size, other.m_size));
+        return r != 0 ? r : (m_size < other.m_size ? -1 : m_size > other.m_size);
+    }
+    bool operator== (string_view rhs) const { return m_size == rhs.m_size && compare(rhs) == 0; }
+    bool operator!= (string_view rhs) const { return !(*this == rhs); }
+    bool operator<  (string_view rhs) const { return compare(rhs) < 0; }
+
+private:
+    const char * m_data;
+    size_t m_size;
+};
+
+// The number of references to a shared value: strings, arrays, objects,
+// long keys and arenas. Atomic, so that copies of a Json may be used and
+// dropped on any thread. A program whose Json values never cross threads,
+// like single-threaded request handlers, may build everything with
+// JSON_CONF_PLAIN_REFCOUNT defined (b2 refcount=plain) to count with plain
+// increments instead.
+//
+// A count made immortal before the value is shared is left alone, so
+// threads that share a value that is never freed do not contend for it.
+// The count takes 32 bits, the rest of a JsonValue's word holds its size.
+class ref_count final {
+public:
+    explicit ref_count(int count) noexcept : m_count(count) {}
+    ref_count(const ref_count &) = delete;
+    ref_count &operator=(const ref_count &) = delete;
+
+#ifdef JSON_CONF_PLAIN_REFCOUNT
+    void retain() noexcept {
+        if (m_count >= 0)
+            ++m_count;
+    }
+    // Whether the last reference was dropped.
+    bool release() noexcept { return m_count >= 0 && --m_count == 0; }
+    bool unique() const noexcept { return m_count == 1; }
+    void make_immortal() noexcept { m_count = -1; }
+
+private:
+    int m_count;
+#else
+    void retain() noexcept {
+        if (m_count.load(std::memory_order_relaxed) >= 0)
+            m_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    // Whether the last reference was dropped.
+    bool release() noexcept {
+        return m_count.load(std::memory_order_relaxed) >= 0
+            && m_count.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+    bool unique() const noexcept { return m_count.load(std::memory_order_acquire) == 1; }
+    void make_immortal() noexcept { m_count.store(-1, std::memory_order_relaxed); }
+
+private:
+    std::atomic<int> m_count;
+#endif
+};
+
+// The key of an object member. Keys of up to 15 bytes are stored inline,
+// longer ones in an immutable, reference counted atom that copies share,
+// and with Json::PARSE_INTERN_KEYS so do all keys with the same text parsed
+// on a thread. Equal keys then compare by pointer.
+class object_key final {
+public:
+    object_key() noexcept { clear(); }
+    object_key(const std::string &text) : object_key(string_view(text)) {}
+    object_key(const char *text) : object_key(string_view(text)) {}
+    object_key(string_view text);
+    object_key(const object_key &other) noexcept {
+        copy(other);
+        if (!is_inline())
+            m_atom->refs.retain();
+    }
+    object_key(object_key &&other) noexcept {
+        copy(other);
+        other.clear();
+    }
+    object_key &operator=(object_key other) noexcept {
+        std::swap(m_word[0], other.m_word[0]);
+        std::swap(m_word[1], other.m_word[1]);
+        return *this;
+    }
+    ~object_key() {
+        if (!is_inline())
+            m_atom->release();
+    }
+
+    string_view view() const {
+        return is_inline() ? string_view(m_text, max_inline - m_text[max_inline])
+                           : string_view(m_atom->chars(), m_atom->size);
+    }
+    std::string str() const { return view().to_string(); }
+    operator std::string() const { return str(); }
+    // Zero-terminated.
+    const char *data() const { return is_inline() ? m_text : m_atom->chars(); }
+    const char *c_str() const { return data(); }
+    size_t size() const { return view().size(); }
+    bool empty() const { return size() == 0; }
+    // FNV-1a of the text, computed once for long keys.
+    uint32_t hash() const;
+
+    bool operator== (const object_key &rhs) const {
+        if (is_inline())
+            return m_word[0] == rhs.m_word[0] && m_word[1] == rhs.m_word[1];
+        return m_atom == rhs.m_atom || (!rhs.is_inline() && view() == rhs.view());
+    }
+    bool operator!= (const object_key &rhs) const { return !(*this == rhs); }
+    bool operator<  (const object_key &rhs) const { return view() < rhs.view(); }
+
+    // Comparisons with std::string, string_view and C strings.
+    template <class T, typename std::enable_if<
+        !std::is_same<T, object_key>::value && std::is_convertible<const T &, string_view>::value,
+            int>::type = 0>
+    friend bool operator== (const object_key &lhs, const T &rhs) { return lhs.view() == string_view(rhs); }
+    template <class T, typename std::enable_if<
+        !std::is_same<T, object_key>::value && std::is_convertible<const T &, string_view>::value,
+            int>::type = 0>
+    friend bool operator== (const T &lhs, const object_key &rhs) { return rhs.view() == string_view(lhs); }
+    template <class T, typename std::enable_if<
+        !std::is_same<T, object_key>::value && std::is_convertible<const T &, string_view>::value,
+            int>::type = 0>
+    friend bool operator!= (const object_key &lhs, const T &rhs) { return !(lhs == rhs); }
+    template <class T, typename std::enable_if<
+        !std::is_same<T, object_key>::value && std::is_convertible<const T &, string_view>::value,
+            int>::type = 0>
+    friend bool operator!= (const T &lhs, const object_key &rhs) { return !(rhs == lhs); }
+
+private:
+    friend class KeyPool;
+
+    static const size_t max_inline = 15;
+    static const char atom_tag = -1;
+
+    // The text follows the atom.
+    struct atom {
+        ref_count refs;
+        const size_t size;
+        const uint32_t hash;
+
+        const char *chars() const { return reinterpret_cast<const char *>(this + 1); }
+        static atom *make(string_view text, uint32_t hash, long refs);
+        void release();
+
+    private:
+        atom(size_t size, uint32_t hash, long refs) : refs(refs), size(size), hash(hash) {}
+    };
+
+    // Takes over the reference the caller holds on shared.
+    explicit object_key(atom *shared) noexcept {
+        m_word[0] = m_word[1] = 0;
+        m_atom = shared;
+        m_text[max_inline] = atom_tag;
+    }
+
+    bool is_inline() const { return m_text[max_inline] != atom_tag; }
+    void copy(const object_key &other) {
+        m_word[0] = other.m_word[0];
+        m_word[1] = other.m_word[1];
+    }
+    void clear() {
+        m_word[0] = m_word[1] = 0;
+        m_text[max_inline] = max_inline;
+    }
+
+    // Inline the text is zero padded and the last byte is max_inline minus
+    // its size, otherwise that byte is atom_tag.
+    union {
+        atom *m_atom;
+        char m_text[max_inline + 1];
+        uint64_t m_word[2];
+    };
+};
+
+// Whether T converts to Json through a to_json() member.
+template <class T, class = void>
+struct has_to_json : std::false_type {};
+template <class T>
+struct has_to_json<T, decltype((void)&T::to_json)> : std::true_type {};
 
 class Json final {
 public:
@@ -18,14 +229,16 @@ public:
 
     // Array and object typedefs
     typedef std::vector<Json> array;
-    typedef std::map<std::string, Json> object;
+    typedef object_map object;
 
     // Constructors for the various types of JSON value.
-    Json() noexcept;                // NUL
-    Json(std::nullptr_t) noexcept;  // NUL
-    Json(double value);             // NUMBER
-    Json(int value);                // NUMBER
-    Json(bool value);               // BOOL
+    Json() noexcept               : m_uint(0), m_kind(K_NULL) {}          // NUL
+    Json(std::nullptr_t) noexcept : m_uint(0), m_kind(K_NULL) {}          // NUL
+    Json(double value) noexcept   : m_double(value), m_kind(K_DOUBLE) {}  // NUMBER
+    Json(int value) noexcept      : m_int(value), m_kind(K_INT) {}        // NUMBER
+    Json(int64_t value) noexcept  : m_int(value), m_kind(K_INT) {}        // NUMBER
+    Json(uint64_t value) noexcept : m_uint(value), m_kind(K_UINT) {}      // NUMBER
+    Json(bool value) noexcept     : m_uint(0), m_kind(K_BOOL) { m_bool = value; } // BOOL
     Json(const std::string &value); // STRING
     Json(std::string &&value);      // STRING
     Json(const char * value);       // STRING
@@ -47,7 +260,8 @@ public:
 
     // Implicit constructor: vector-like objects (std::list, std::vector, std::set, etc)
     template <class V, typename std::enable_if<
-        std::is_constructible<Json, decltype(*std::declval<V>().begin())>::value,
+        std::is_constructible<Json, decltype(*std::declval<V>().begin())>::value
+        && !has_to_json<V>::value,
             int>::type = 0>
     Json(const V & v) : Json(array(v.begin(), v.end())) {}
 
@@ -55,8 +269,23 @@ public:
     // Json(bool(some_pointer)) if that behavior is desired.
     Json(void *) = delete;
 
+    // Copies share strings, arrays and objects.
+    Json(const Json &other) noexcept;
+    Json(Json &&other) noexcept;
+    Json &operator=(Json other) noexcept;
+    ~Json();
+
     // Accessors
-    Type type() const;
+    Type type() const {
+        switch (m_kind) {
+            case K_NULL:   return NUL;
+            case K_BOOL:   return BOOL;
+            case K_STRING: return STRING;
+            case K_ARRAY:  return ARRAY;
+            case K_OBJECT: return OBJECT;
+            default:       return NUMBER;
+        }
+    }
 
     bool is_null()   const { return type() == NUL; }
     bool is_number() const { return type() == NUMBER; }
@@ -65,16 +294,31 @@ public:
     bool is_array()  const { return type() == ARRAY; }
     bool is_object() const { return type() == OBJECT; }
 
-    double number_value() const;
-    int int_value() const;
+    // Return the enclosed number if this is a number, 0 otherwise.
+    double number_value() const {
+        switch (m_kind) {
+            case K_DOUBLE: return m_double;
+            case K_INT:    return m_int;
+            case K_UINT:   return m_uint;
+            default:       return 0;
+        }
+    }
+    int int_value() const { return number_as<int>(); }
+    // Integers keep their exact value up to 64 bits, other numbers are
+    // converted like int_value() does.
+    int64_t int64_value() const { return number_as<int64_t>(); }
+    uint64_t uint64_value() const { return number_as<uint64_t>(); }
 
     // Return the enclosed value if this is a boolean, false otherwise.
-    bool bool_value() const;
+    bool bool_value() const { return m_kind == K_BOOL && m_bool; }
     // Return the enclosed string if this is a string, "" otherwise.
     const std::string &string_value() const;
+    // The same without a copy; strings parsed in situ or borrowed refer to
+    // the parsed text.
+    string_view string_view_value() const;
     // Return the enclosed std::vector if this is an array, or an empty vector otherwise.
     const array &array_items() const;
-    // Return the enclosed std::map if this is an object, or an empty map otherwise.
+    // Return the enclosed members if this is an object, or an empty object otherwise.
     const object &object_items() const;
 
     // Return a reference to arr[i] if this is an array, Json() otherwise.
@@ -82,24 +326,88 @@ public:
     // Return a reference to obj[key] if this is an object, Json() otherwise.
     const Json & operator[](const std::string &key) const;
 
-    // Serialize.
+    // Modifiers. An array or object that other copies share is copied
+    // first, without its elements: changing a nested value copies the
+    // nodes on the path to it and the rest of the tree stays shared. A
+    // null Json becomes an empty array or object; other types throw
+    // std::domain_error. References into the value are invalidated.
+    //
+    // Element i of an array, which grows with nulls to hold it. Read
+    // through a const Json to get the accessor above.
+    Json & operator[](size_t i);
+    // Member key of an object, inserted as null if there is none.
+    Json & operator[](const std::string &key);
+    void set(const std::string &key, Json value) { (*this)[key] = std::move(value); }
+    void push_back(Json value);
+    // Remove member key of an object, return the number of members removed.
+    size_t erase(string_view key);
+    // Remove element i of an array, if there is one.
+    void erase(size_t i);
+
+    // Serialize. The output is sized exactly first and written in place
+    // after.
     void dump(std::string &out) const;
     std::string dump() const {
         std::string out;
         dump(out);
         return out;
     }
+    // The length of dump() in bytes. Strings keep theirs once known, so
+    // sizing them again does not scan them for characters to escape.
+    size_t dump_size() const;
+    // Write the dump_size() bytes of dump() to out, unterminated, and
+    // return the end of them.
+    char *dump(char *out) const;
+    // Serialize to a sink in pieces, through a buffer of fixed size, so
+    // memory use does not grow with the output and the first bytes leave
+    // early. The writer returns false when it fails; dump_to() then stops
+    // and returns false, errno tells why for a descriptor or a FILE.
+    typedef std::function<bool (const char *data, size_t size)> writer;
+    bool dump_to(const writer &write) const;
+    bool dump_to(int fd) const;
+    bool dump_to(std::FILE *file) const;
+    bool dump_to(std::ostream &out) const;
+
+    // Parse options, may be combined with '|'.
+    enum ParseOption {
+        PARSE_DEFAULT = 0,
+        // Find all structural characters with SIMD first, then build the
+        // tree from that index instead of pulling one token at a time.
+        // Accepts what the default parser does, which is laxer than JSON:
+        // only an object or array at the top, optional and repeated commas
+        // in arrays, a trailing comma in objects, values without a comma
+        // between them in arrays, and trailing text. A ':' outside of a
+        // pair is an error here, the default parser takes it for a null.
+        PARSE_STRUCTURAL_INDEX = 1 << 0,
+        // Place the nodes and strings of the document in one arena that is
+        // freed at once when the last of them goes away. Arrays and objects
+        // still keep their elements on the heap.
+        PARSE_ARENA = 1 << 1,
+        // Share object keys with the other documents parsed on this thread
+        // with this option, instead of only within the document. Keys of
+        // up to 256 bytes are interned, the first 65536 distinct ones.
+        PARSE_INTERN_KEYS = 1 << 2,
+    };
 
     // Parse. If parse fails, return Json() and assign an error message to err.
-    static Json parse(const std::string & in, std::string & err);
-    static Json parse(const char * in, std::string & err) {
-        if (in) {
-            return parse(std::string(in), err);
-        } else {
-            err = "null input";
-            return nullptr;
-        }
-    }
+    static Json parse(const std::string & in, std::string & err, int options = PARSE_DEFAULT);
+    static Json parse(const char * in, std::string & err, int options = PARSE_DEFAULT);
+    // Parse text the result takes over: escapes are decoded in the buffer
+    // and strings refer to it, short ones excepted, so it lives as long as
+    // any of them does.
+    static Json parse(std::string && in, std::string & err, int options = PARSE_DEFAULT);
+    // The same for buffer[0, len), which has to be followed by a zero.
+    static Json parse(std::unique_ptr<char[]> buffer, size_t len, std::string & err,
+                      int options = PARSE_DEFAULT);
+    // Parse a mutable, zero-terminated buffer in place: escapes are decoded
+    // into the buffer itself and parsed strings refer to it instead of
+    // being copied, so the buffer has to outlive the result.
+    static Json parse_insitu(char * buffer, std::string & err, int options = PARSE_DEFAULT);
+    // Parse without copying strings: strings without escapes refer to *in,
+    // which the result keeps alive. Escaped strings are decoded into copies,
+    // and so are short ones, which std::string keeps inline anyway.
+    static Json parse_borrowed(std::shared_ptr<const std::string> in, std::string & err,
+                               int options = PARSE_DEFAULT);
     // Parse multiple objects, concatenated or separated by whitespace
     static std::vector<Json> parse_multi(const std::string & in, std::string & err);
 
@@ -119,28 +427,341 @@ public:
     bool has_shape(const shape & types, std::string & err) const;
 
 private:
-    std::shared_ptr<JsonValue> m_ptr;
+    friend class JsonParser;
+
+    // What the value holds. Null, booleans and numbers are stored inline,
+    // strings, arrays and objects in a reference counted JsonValue.
+    enum Kind : unsigned char {
+        K_NULL, K_BOOL, K_DOUBLE, K_INT, K_UINT, K_STRING, K_ARRAY, K_OBJECT
+    };
+
+    // Takes over the reference the caller holds on value.
+    Json(Type type, JsonValue * value) noexcept
+        : m_ptr(value), m_kind(type == STRING ? K_STRING : type == ARRAY ? K_ARRAY : K_OBJECT) {}
+
+    bool has_value() const { return m_kind >= K_STRING; }
+    // The elements of an array and members of an object to change, see
+    // the modifiers.
+    array &mutable_array();
+    object &mutable_object();
+
+    template <typename T>
+    T number_as() const {
+        switch (m_kind) {
+            case K_DOUBLE: return static_cast<T>(m_double);
+            case K_INT:    return static_cast<T>(m_int);
+            case K_UINT:   return static_cast<T>(m_uint);
+            default:       return 0;
+        }
+    }
+
+    union {
+        bool m_bool;
+        double m_double;
+        int64_t m_int;
+        uint64_t m_uint;
+        JsonValue * m_ptr;
+    };
+    Kind m_kind;
+};
+
+// The members of a JSON object, sorted by key in one contiguous array.
+// Small objects are searched linearly, larger ones by binary search, and
+// very large ones through a hash index that the first lookup builds from
+// key hashes computed up front; inserting or erasing a member hashes only
+// its key. Otherwise this works like the std::map it replaces.
+class object_map final {
+public:
+    typedef std::pair<object_key, Json> value_type;
+    typedef std::vector<value_type>::const_iterator const_iterator;
+    typedef const_iterator iterator;
+    typedef std::vector<value_type>::const_reverse_iterator const_reverse_iterator;
+    typedef size_t size_type;
+
+    object_map() noexcept : m_index(nullptr) {}
+    // A key given more than once keeps its first value, like std::map does.
+    object_map(std::initializer_list<value_type> members)
+        : m_members(members), m_index(nullptr) { prepare(false); }
+    template <class It>
+    object_map(It first, It last)
+        : m_members(first, last), m_index(nullptr) { prepare(false); }
+    // A key given more than once keeps its last value, like Json::parse() does.
+    explicit object_map(std::vector<value_type> &&members)
+        : m_members(std::move(members)), m_index(nullptr) { prepare(true); }
+
+    object_map(const object_map &other);
+    object_map(object_map &&other) noexcept;
+    object_map &operator=(object_map other) noexcept;
+    ~object_map();
+
+    size_t size() const { return m_members.size(); }
+    bool empty() const { return m_members.empty(); }
+    const_iterator begin() const { return m_members.begin(); }
+    const_iterator end() const { return m_members.end(); }
+    const_reverse_iterator rbegin() const { return m_members.rbegin(); }
+    const_reverse_iterator rend() const { return m_members.rend(); }
+
+    // The member with key, or end().
+    const_iterator find(string_view key) const;
+    size_t count(string_view key) const { return find(key) != end(); }
+    // The value of key, throws std::out_of_range if there is none.
+    const Json &at(string_view key) const;
+
+    // The value of key, inserted as null if there is none.
+    Json &operator[](const std::string &key);
+    std::pair<const_iterator, bool> insert(value_type member);
+    size_t erase(string_view key);
+    void clear();
+
+    bool operator== (const object_map &rhs) const { return m_members == rhs.m_members; }
+    bool operator<  (const object_map &rhs) const { return m_members <  rhs.m_members; }
+    bool operator!= (const object_map &rhs) const { return m_members != rhs.m_members; }
+
+private:
+    struct hash_index;
+
+    std::vector<value_type>::iterator lower_bound(string_view key);
+    const_iterator find_hashed(string_view key) const;
+    void prepare(bool keep_last);
+    void changed();
+    void inserted(size_t i);
+
+    std::vector<value_type> m_members;
+    // The key hashes of objects large enough to be searched through them,
+    // null for others.
+    hash_index *m_index;
 };
 
 // Internal class hierarchy - JsonValue objects are not exposed to users of this API.
+// Every Json that holds one owns a reference to it.
 class JsonValue {
 protected:
     friend class Json;
-    friend class JsonInt;
-    friend class JsonDouble;
+    friend class JsonString;
+    friend class JsonStringRef;
+    JsonValue() noexcept : m_refs(1), m_dump_size(0) {}
     virtual Json::Type type() const = 0;
     virtual bool equals(const JsonValue * other) const = 0;
     virtual bool less(const JsonValue * other) const = 0;
-    virtual void dump(std::string &out) const = 0;
-    virtual double number_value() const;
-    virtual int int_value() const;
-    virtual bool bool_value() const;
+    // The length of dump(), counted, and the writer of the value.
+    virtual size_t measure() const = 0;
+    virtual char *dump(char *out) const = 0;
     virtual const std::string &string_value() const;
+    virtual string_view string_view_value() const;
     virtual const Json::array &array_items() const;
     virtual const Json &operator[](size_t i) const;
     virtual const Json::object &object_items() const;
     virtual const Json &operator[](const std::string &key) const;
     virtual ~JsonValue() {}
+    // Free the value once the last reference is gone.
+    virtual void destroy() { delete this; }
+    // Never free the value, for values shared by the whole program.
+    void make_immortal() { m_refs.make_immortal(); }
+
+    // The length of dump(). Strings, which cannot change, keep theirs once
+    // counted while it fits into 32 bits; arrays and objects are counted
+    // each time. Two threads may count a string at once, they store the
+    // same.
+    size_t dump_size() const {
+        const size_t size = m_dump_size.load(std::memory_order_relaxed);
+        return size ? size : measure();
+    }
+    size_t remember_dump_size(size_t size) const {
+        if (size <= UINT32_MAX)
+            m_dump_size.store(static_cast<uint32_t>(size), std::memory_order_relaxed);
+        return size;
+    }
+
+    // Whether a Json other than the one asking holds a reference.
+    bool shared() const { return !m_refs.unique(); }
+    void retain() const { m_refs.retain(); }
+    void release() const {
+        if (m_refs.release())
+            const_cast<JsonValue *>(this)->destroy();
+    }
+
+private:
+    mutable ref_count m_refs;
+    // 0 while not known, and for arrays and objects, which may change in
+    // place; no value dumps to nothing.
+    mutable std::atomic<uint32_t> m_dump_size;
+};
+
+inline Json::Json(const Json &other) noexcept : m_uint(other.m_uint), m_kind(other.m_kind) {
+    if (has_value())
+        m_ptr->retain();
+}
+
+inline Json::Json(Json &&other) noexcept : m_uint(other.m_uint), m_kind(other.m_kind) {
+    other.m_uint = 0;
+    other.m_kind = K_NULL;
+}
+
+inline Json &Json::operator=(Json other) noexcept {
+    std::swap(m_uint, other.m_uint);
+    std::swap(m_kind, other.m_kind);
+    return *this;
+}
+
+inline Json::~Json() {
+    if (has_value())
+        m_ptr->release();
+}
+
+class JsonDocument;
+
+// A value in a JsonDocument: a position on its tape, valid as long as the
+// document is. Reads like a const Json; to_json() makes a Json tree of the
+// value, and so does passing it where a Json is expected.
+class JsonElement final {
+public:
+    // The elements of an array, or the members of an object in document
+    // order, where key() is the key of the member.
+    class iterator final {
+    public:
+        JsonElement operator*() const { return JsonElement(m_members ? m_word + 1 : m_word, m_strings); }
+        string_view key() const { return m_members ? string_at(m_word, m_strings) : string_view(); }
+        iterator &operator++() {
+            m_word = next(m_members ? m_word + 1 : m_word);
+            return *this;
+        }
+        bool operator== (const iterator &rhs) const { return m_word == rhs.m_word; }
+        bool operator!= (const iterator &rhs) const { return m_word != rhs.m_word; }
+
+    private:
+        friend class JsonElement;
+        iterator(const uint64_t *word, const char *strings, bool members) noexcept
+            : m_word(word), m_strings(strings), m_members(members) {}
+
+        const uint64_t *m_word;
+        const char *m_strings;
+        bool m_members;
+    };
+
+    Json::Type type() const {
+        switch (tag(m_word)) {
+            case 't': case 'f':                     return Json::BOOL;
+            case 'i': case 'l': case 'u': case 'd': return Json::NUMBER;
+            case '"':                               return Json::STRING;
+            case '[':                               return Json::ARRAY;
+            case '{':                               return Json::OBJECT;
+            default:                                return Json::NUL;
+        }
+    }
+    bool is_null()   const { return type() == Json::NUL; }
+    bool is_number() const { return type() == Json::NUMBER; }
+    bool is_bool()   const { return type() == Json::BOOL; }
+    bool is_string() const { return type() == Json::STRING; }
+    bool is_array()  const { return type() == Json::ARRAY; }
+    bool is_object() const { return type() == Json::OBJECT; }
+
+    // Like the accessors of Json: 0, false or "" for other types.
+    double number_value() const {
+        switch (tag(m_word)) {
+            case 'i': return (double)small_int(m_word);
+            case 'l': return (double)(int64_t)m_word[1];
+            case 'u': return (double)m_word[1];
+            case 'd': {
+                double value;
+                std::memcpy(&value, m_word + 1, sizeof value);
+                return value;
+            }
+            default:  return 0;
+        }
+    }
+    int int_value() const { return (int)int64_value(); }
+    int64_t int64_value() const;
+    uint64_t uint64_value() const;
+    bool bool_value() const { return tag(m_word) == 't'; }
+    string_view string_view_value() const {
+        return tag(m_word) == '"' ? string_at(m_word, m_strings) : string_view();
+    }
+    std::string string_value() const { return string_view_value().to_string(); }
+
+    // The number of elements of an array or members of an object, 0 for
+    // other types.
+    size_t size() const;
+    // Element i of an array, found by skipping the ones before it; null if
+    // there is none.
+    JsonElement operator[](size_t i) const;
+    // Member key of an object, found by scanning all members, the last one
+    // if the key repeats like with Json::parse(); null if there is none.
+    JsonElement operator[](string_view key) const;
+    iterator begin() const;
+    iterator end() const;
+
+    Json to_json() const;
+
+private:
+    friend class JsonDocument;
+    friend class JsonTapeParser;
+
+    JsonElement(const uint64_t *word, const char *strings) noexcept
+        : m_word(word), m_strings(strings) {}
+
+    // The tape format, see JsonDocument.
+    static const int tag_shift = 56;
+    static const uint32_t long_string = 0xffffffff;
+
+    static uint64_t word(char tag, uint64_t payload) {
+        return (uint64_t)(unsigned char)tag << tag_shift | payload;
+    }
+    static char tag(const uint64_t *word) { return (char)(*word >> tag_shift); }
+    static uint64_t payload(const uint64_t *word) { return *word & (((uint64_t)1 << tag_shift) - 1); }
+    static int64_t small_int(const uint64_t *word) { return (int64_t)(*word << 8) >> 8; }
+    // The word after the value at word.
+    static const uint64_t *next(const uint64_t *word) {
+        switch (tag(word)) {
+            case '[': case '{':           return word + payload(word);
+            case 'l': case 'u': case 'd': return word + 2;
+            default:                      return word + 1;
+        }
+    }
+    static string_view string_at(const uint64_t *word, const char *strings) {
+        const char *at = strings + payload(word);
+        uint32_t size;
+        std::memcpy(&size, at, sizeof size);
+        if (size != long_string)
+            return string_view(at + sizeof size, size);
+        uint64_t long_size;
+        std::memcpy(&long_size, at + sizeof size, sizeof long_size);
+        return string_view(at + sizeof size + sizeof long_size, long_size);
+    }
+
+    const uint64_t *m_word;
+    const char *m_strings;
+};
+
+// A parsed document for reading only, without a tree: every value is one
+// or two 64 bit words on a contiguous tape, and the decoded strings follow
+// each other in one buffer. Parsing takes a few allocations, navigation
+// none. A tape word holds a tag in the top byte and a payload below it:
+//   'n' 't' 'f'  null, true and false
+//   'i'          an integer that fits into the 56 bit payload
+//   'l' 'u' 'd'  an int64_t, uint64_t or double, its bits in the next word
+//   '"'          the offset of a string in the buffer, which starts with
+//                its size as uint32_t, or 0xffffffff and a uint64_t
+//   '[' '{'      the distance to the word after the closing one
+//   ']' '}'      the number of elements or members
+// A member of an object is the string of its key followed by the value.
+class JsonDocument final {
+public:
+    JsonDocument() = default;
+
+    // Parse with the tokenizer of Json::parse(). If parse fails, the
+    // document is null and err holds the message Json::parse() gives.
+    static JsonDocument parse(const std::string & in, std::string & err);
+
+    JsonElement root() const { return JsonElement(m_tape.data(), m_strings.data()); }
+    Json to_json() const { return root().to_json(); }
+    // The bytes taken by the tape and the strings.
+    size_t memory_usage() const { return m_tape.capacity() * sizeof(uint64_t) + m_strings.capacity(); }
+
+private:
+    friend class JsonTapeParser;
+
+    std::vector<uint64_t> m_tape { (uint64_t)'n' << 56 };
+    std::vector<char> m_strings;
 };
 
 }
@@ -1,15 +1,31 @@
 
 #include <c/json.h>
 #include <c/jsonparse.h>
+#include <c/jsonindex.h>
+#include <c/jsonnumber.h>
 #include <cpp/json.hpp>
+#include "./jsonsimd.h"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <climits>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <ostream>
 #include <limits>
+#include <stdexcept>
+#include <new>
 #include <utility>
-#include <map>
 #include <string>
 #include <vector>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 namespace xusd {
 
@@ -17,96 +33,473 @@ static const int max_depth = JSONPARSE_MAX_DEPTH;
 
 using std::string;
 using std::vector;
-using std::map;
-using std::make_shared;
 using std::initializer_list;
 using std::move;
 
-static void dump(std::nullptr_t, string &out) {
-    out += "null";
-}
-
-static void dump(double value, string &out) {
-    char buf[32];
-    snprintf(buf, sizeof buf, "%.17g", value);
-    out += buf;
-}
-
-static void dump(int value, string &out) {
-    char buf[32];
-    snprintf(buf, sizeof buf, "%d", value);
-    out += buf;
-}
-
-static void dump(bool value, string &out) {
-    out += value ? "true" : "false";
-}
-
-static void dump(const string &value, string &out) {
-    out += '"';
-    for (size_t i = 0; i < value.length(); i++) {
-        const char ch = value[i];
-        if (ch == '\\') {
-            out += "\\\\";
-        } else if (ch == '"') {
-            out += "\\\"";
-        } else if (ch == '\b') {
-            out += "\\b";
-        } else if (ch == '\f') {
-            out += "\\f";
-        } else if (ch == '\n') {
-            out += "\\n";
-        } else if (ch == '\r') {
-            out += "\\r";
-        } else if (ch == '\t') {
-            out += "\\t";
-        } else if ((uint8_t)ch <= 0x1f) {
-            char buf[8];
-            snprintf(buf, sizeof buf, "\\u%04x", ch);
-            out += buf;
-        } else if ((uint8_t)ch == 0xe2 && (uint8_t)value[i+1] == 0x80
-                   && (uint8_t)value[i+2] == 0xa8) {
-            out += "\\u2028";
-            i += 2;
-        } else if ((uint8_t)ch == 0xe2 && (uint8_t)value[i+1] == 0x80
-                   && (uint8_t)value[i+2] == 0xa9) {
-            out += "\\u2029";
-            i += 2;
-        } else {
-            out += ch;
+/* Serialization counts the bytes of a value first and writes them into
+ * place after, see Json::dump(). The dump_size() and dump() of each type
+ * below go together.
+ */
+
+/* FormattedDoubles
+ *
+ * Counting a double takes most of the work of writing it. While
+ * Json::dump(std::string&) counts its output, each double is formatted
+ * into one of these, and writing copies them back in the same order.
+ * The copies are JSONNUMBER_FORMAT_MAX bytes whatever the length, which
+ * beats a memcpy() of the length by far; the bytes past the number are
+ * written over by what follows it, the output has room for them at the
+ * end.
+ */
+class FormattedDoubles {
+    vector<char> text;
+    size_t used, read;
+
+public:
+    FormattedDoubles() : used(0), read(0) {}
+
+    // The double, formatted behind a byte with its length.
+    size_t format(double value) {
+        if (text.size() - used < 1 + 2 * JSONNUMBER_FORMAT_MAX)
+            text.resize(std::max<size_t>(4096, 2 * text.size()));
+        const int len = jsonnumber_format(value, &text[used + 1]);
+        text[used] = (char)len;
+        used += 1 + len;
+        return len;
+    }
+    // The next one formatted, or 0 bytes for infinity and NaN.
+    char *copy(char *out) {
+        const size_t len = (uint8_t)text[read];
+        memcpy(out, &text[read + 1], JSONNUMBER_FORMAT_MAX);
+        read += 1 + len;
+        return out + len;
+    }
+};
+
+// The one of this thread's Json::dump(std::string&), null outside of it.
+static FormattedDoubles *&formatted_doubles() {
+    static thread_local FormattedDoubles *current = nullptr;
+    return current;
+}
+
+// JSON has no infinity or NaN, they are written as null.
+static size_t dump_size(double value) {
+    FormattedDoubles * const formatted = formatted_doubles();
+    const int len = formatted ? formatted->format(value) : jsonnumber_format_size(value);
+    return len ? len : 4;
+}
+
+static char *dump(double value, char *out) {
+    FormattedDoubles * const formatted = formatted_doubles();
+    char * const end = formatted ? formatted->copy(out) : out + jsonnumber_format(value, out);
+    if (end != out)
+        return end;
+    memcpy(out, "null", 4);
+    return out + 4;
+}
+
+static size_t dump_size(uint64_t value) {
+    return jsonnumber_format_uint64_size(value);
+}
+
+static char *dump(uint64_t value, char *out) {
+    return out + jsonnumber_format_uint64(value, out);
+}
+
+static size_t dump_size(int64_t value) {
+    return jsonnumber_format_int64_size(value);
+}
+
+static char *dump(int64_t value, char *out) {
+    return out + jsonnumber_format_int64(value, out);
+}
+
+/* Strings are copied in runs between the bytes that need a closer look:
+ * a quote, a backslash, a control character, or 0xe2, the lead byte of
+ * U+2028 and U+2029. Whole blocks are scanned with SSE2 or AVX2.
+ */
+
+#ifdef JSONPARSE_SIMD_X86
+__attribute__((target("sse2")))
+static size_t scan_escape_sse2(const char *s, size_t pos, size_t len) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i bslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    const __m128i lead = _mm_set1_epi8((char)0xe2);
+    while (pos + 16 <= len) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(s + pos));
+        const __m128i hit = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash)),
+            _mm_or_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, control), control), _mm_cmpeq_epi8(v, lead)));
+        const unsigned int mask = (unsigned int)_mm_movemask_epi8(hit);
+        if (mask != 0)
+            return pos + __builtin_ctz(mask);
+        pos += 16;
+    }
+    return pos;
+}
+
+__attribute__((target("avx2")))
+static size_t scan_escape_avx2(const char *s, size_t pos, size_t len) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i bslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1f);
+    const __m256i lead = _mm256_set1_epi8((char)0xe2);
+    while (pos + 32 <= len) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)(s + pos));
+        const __m256i hit = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, bslash)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(v, control), control),
+                            _mm256_cmpeq_epi8(v, lead)));
+        const unsigned int mask = (unsigned int)_mm256_movemask_epi8(hit);
+        if (mask != 0)
+            return pos + __builtin_ctz(mask);
+        pos += 32;
+    }
+    return pos;
+}
+#endif
+
+static inline bool needs_escape(uint8_t ch) {
+    return ch == '"' || ch == '\\' || ch <= 0x1f || ch == 0xe2;
+}
+
+// The position of the next byte at or after pos that needs a closer look,
+// or len.
+static size_t scan_escape(const char *s, size_t pos, size_t len) {
+#ifdef JSONPARSE_SIMD_X86
+    // keys and short values are done before the vector unit would pay off
+    if (len - pos >= 16) {
+        switch (simd_level()) {
+            case SIMD_AVX2:
+                pos = scan_escape_avx2(s, pos, len);
+                break;
+            case SIMD_SSE2:
+                pos = scan_escape_sse2(s, pos, len);
+                break;
+        }
+    }
+#endif
+    while (pos < len && !needs_escape((uint8_t)s[pos]))
+        pos++;
+    return pos;
+}
+
+// The escape of the byte at s[i] that scan_escape() stopped at, written
+// to escape, and the number of bytes it replaces; 0 for a character that
+// starts with 0xe2 and is copied as is.
+static size_t escape_at(const char *s, size_t i, size_t len, char *escape, size_t &consumed) {
+    static const char hex[] = "0123456789abcdef";
+    const uint8_t ch = (uint8_t)s[i];
+    escape[0] = '\\';
+    consumed = 1;
+    switch (ch) {
+        case '\\':
+        case '"':  escape[1] = ch;  return 2;
+        case '\b': escape[1] = 'b'; return 2;
+        case '\f': escape[1] = 'f'; return 2;
+        case '\n': escape[1] = 'n'; return 2;
+        case '\r': escape[1] = 'r'; return 2;
+        case '\t': escape[1] = 't'; return 2;
+    }
+    if (ch <= 0x1f) {
+        memcpy(escape + 1, "u00", 3);
+        escape[4] = hex[ch >> 4];
+        escape[5] = hex[ch & 0xf];
+        return 6;
+    }
+    if (i + 2 < len && (uint8_t)s[i+1] == 0x80 && ((uint8_t)s[i+2] == 0xa8 || (uint8_t)s[i+2] == 0xa9)) {
+        memcpy(escape + 1, (uint8_t)s[i+2] == 0xa8 ? "u2028" : "u2029", 5);
+        consumed = 3;
+        return 6;
+    }
+    return 0;
+}
+
+static size_t dump_size(string_view value) {
+    const char *s = value.data();
+    const size_t len = value.length();
+    size_t size = len + 2;
+    char escape[6];
+    size_t consumed;
+    for (size_t i = scan_escape(s, 0, len); i < len; i = scan_escape(s, i, len)) {
+        const size_t escape_len = escape_at(s, i, len, escape, consumed);
+        if (escape_len == 0) {
+            i++;
+            continue;
+        }
+        size += escape_len - consumed;
+        i += consumed;
+    }
+    return size;
+}
+
+static char *dump(string_view value, char *out) {
+    const char *s = value.data();
+    const size_t len = value.length();
+    size_t copied = 0;
+    char escape[6];
+    size_t consumed;
+    *out++ = '"';
+    for (size_t i = scan_escape(s, 0, len); i < len; i = scan_escape(s, i, len)) {
+        const size_t escape_len = escape_at(s, i, len, escape, consumed);
+        if (escape_len == 0) {
+            i++;
+            continue;
         }
+        memcpy(out, s + copied, i - copied);
+        out += i - copied;
+        memcpy(out, escape, escape_len);
+        out += escape_len;
+        i += consumed;
+        copied = i;
     }
-    out += '"';
+    memcpy(out, s + copied, len - copied);
+    out += len - copied;
+    *out++ = '"';
+    return out;
 }
 
-static void dump(const Json::array &values, string &out) {
+static size_t dump_size(const Json::array &values) {
+    // brackets and ", " between the elements
+    size_t size = values.empty() ? 2 : 2 * values.size();
+    for (const Json &value : values)
+        size += value.dump_size();
+    return size;
+}
+
+static char *dump(const Json::array &values, char *out) {
     bool first = true;
-    out += "[";
+    *out++ = '[';
     for (auto &value : values) {
-        if (!first)
-            out += ", ";
-        value.dump(out);
+        if (!first) {
+            memcpy(out, ", ", 2);
+            out += 2;
+        }
+        out = value.dump(out);
         first = false;
     }
-    out += "]";
+    *out++ = ']';
+    return out;
+}
+
+static size_t dump_size(const Json::object &values) {
+    // braces, ": " after the keys and ", " between the members
+    size_t size = values.empty() ? 2 : 4 * values.size();
+    for (const Json::object::value_type &kv : values)
+        size += dump_size(kv.first.view()) + kv.second.dump_size();
+    return size;
 }
 
-static void dump(const Json::object &values, string &out) {
+static char *dump(const Json::object &values, char *out) {
     bool first = true;
-    out += "{";
-    for (const std::pair<string, Json> &kv : values) {
-        if (!first)
-            out += ", ";
-        dump(kv.first, out);
-        out += ": ";
-        kv.second.dump(out);
+    *out++ = '{';
+    for (const Json::object::value_type &kv : values) {
+        if (!first) {
+            memcpy(out, ", ", 2);
+            out += 2;
+        }
+        out = dump(kv.first.view(), out);
+        memcpy(out, ": ", 2);
+        out = kv.second.dump(out + 2);
         first = false;
     }
-    out += "}";
+    *out++ = '}';
+    return out;
+}
+
+size_t Json::dump_size() const {
+    switch (m_kind) {
+        case K_NULL:   return 4;
+        case K_BOOL:   return m_bool ? 4 : 5;
+        case K_DOUBLE: return xusd::dump_size(m_double);
+        case K_INT:    return xusd::dump_size(m_int);
+        case K_UINT:   return xusd::dump_size(m_uint);
+        default:       return m_ptr->dump_size();
+    }
+}
+
+char *Json::dump(char *out) const {
+    switch (m_kind) {
+        case K_NULL:
+            memcpy(out, "null", 4);
+            return out + 4;
+        case K_BOOL:
+            if (m_bool) {
+                memcpy(out, "true", 4);
+                return out + 4;
+            }
+            memcpy(out, "false", 5);
+            return out + 5;
+        case K_DOUBLE: return xusd::dump(m_double, out);
+        case K_INT:    return xusd::dump(m_int, out);
+        case K_UINT:   return xusd::dump(m_uint, out);
+        default:       return m_ptr->dump(out);
+    }
 }
 
+// The string grows once, to the exact size and the room the copies of
+// the doubles need past it, and is written in place; the doubles are
+// formatted once, while counting.
 void Json::dump(string &out) const {
-    m_ptr->dump(out);
+    struct Session {
+        FormattedDoubles doubles;
+        Session()  { formatted_doubles() = &doubles; }
+        ~Session() { formatted_doubles() = nullptr; }
+    } session;
+    const size_t start = out.size();
+    const size_t size = dump_size();
+    out.resize(start + size + JSONNUMBER_FORMAT_MAX);
+    char * const end = dump(&out[start]);
+    assert(end == &out[start] + size);
+    (void)end;
+    out.resize(start + size);
+}
+
+/* dump_to() collects the output in a buffer of fixed size and hands it to
+ * the sink whenever the next piece does not fit. Runs of a string that are
+ * longer than the buffer go to the sink directly. After the sink failed
+ * nothing more is written.
+ */
+static const size_t dump_buffer_size = 64 * 1024;
+
+class JsonStream final {
+public:
+    explicit JsonStream(const Json::writer &write)
+        : m_write(write), m_buffer(new char[dump_buffer_size]), m_used(0), m_ok(true) {}
+
+    void dump(const Json &json);
+    bool finish() {
+        flush();
+        return m_ok;
+    }
+
+private:
+    void flush() {
+        if (m_used && m_ok)
+            m_ok = m_write(m_buffer.get(), m_used);
+        m_used = 0;
+    }
+    void append(const char *data, size_t size) {
+        if (dump_buffer_size - m_used < size) {
+            flush();
+            if (size >= dump_buffer_size) {
+                m_ok = m_ok && m_write(data, size);
+                return;
+            }
+        }
+        memcpy(m_buffer.get() + m_used, data, size);
+        m_used += size;
+    }
+    void dump(string_view value);
+
+    const Json::writer &m_write;
+    const std::unique_ptr<char[]> m_buffer;
+    size_t m_used;
+    bool m_ok;
+};
+
+void JsonStream::dump(string_view value) {
+    const char *s = value.data();
+    const size_t len = value.length();
+    size_t copied = 0;
+    char escape[6];
+    size_t consumed;
+    append("\"", 1);
+    for (size_t i = scan_escape(s, 0, len); i < len; i = scan_escape(s, i, len)) {
+        const size_t escape_len = escape_at(s, i, len, escape, consumed);
+        if (escape_len == 0) {
+            i++;
+            continue;
+        }
+        append(s + copied, i - copied);
+        append(escape, escape_len);
+        i += consumed;
+        copied = i;
+    }
+    append(s + copied, len - copied);
+    append("\"", 1);
+}
+
+void JsonStream::dump(const Json &json) {
+    switch (json.type()) {
+        case Json::STRING:
+            dump(json.string_view_value());
+            break;
+        case Json::ARRAY: {
+            bool first = true;
+            append("[", 1);
+            for (const Json &value : json.array_items()) {
+                if (!m_ok)
+                    return;
+                if (!first)
+                    append(", ", 2);
+                dump(value);
+                first = false;
+            }
+            append("]", 1);
+            break;
+        }
+        case Json::OBJECT: {
+            bool first = true;
+            append("{", 1);
+            for (const Json::object::value_type &kv : json.object_items()) {
+                if (!m_ok)
+                    return;
+                if (!first)
+                    append(", ", 2);
+                dump(kv.first.view());
+                append(": ", 2);
+                dump(kv.second);
+                first = false;
+            }
+            append("}", 1);
+            break;
+        }
+        default:
+            // null, booleans and numbers
+            if (dump_buffer_size - m_used < JSONNUMBER_FORMAT_MAX)
+                flush();
+            m_used = json.dump(m_buffer.get() + m_used) - m_buffer.get();
+            break;
+    }
+}
+
+bool Json::dump_to(const writer &write) const {
+    JsonStream stream(write);
+    stream.dump(*this);
+    return stream.finish();
+}
+
+bool Json::dump_to(int fd) const {
+    return dump_to([fd](const char *data, size_t size) {
+        while (size > 0) {
+#ifdef _WIN32
+            const int n = _write(fd, data, static_cast<unsigned int>(std::min<size_t>(size, INT_MAX)));
+#else
+            const ssize_t n = write(fd, data, size);
+#endif
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    });
+}
+
+bool Json::dump_to(FILE *file) const {
+    return dump_to([file](const char *data, size_t size) {
+        return fwrite(data, 1, size, file) == size;
+    });
+}
+
+bool Json::dump_to(std::ostream &out) const {
+    return dump_to([&out](const char *data, size_t size) {
+        return static_cast<bool>(out.write(data, size));
+    });
 }
 
 /* * * * * * * * * * * * * * * * * * * *
@@ -133,42 +526,61 @@ protected:
         return m_value < reinterpret_cast<const Value<tag, T> *>(other)->m_value;
     }
 
-    const T m_value;
-    void dump(string &out) const { xusd::dump(m_value, out); }
-};
+    T m_value;
+    size_t measure() const { return xusd::dump_size(m_value); }
+    char *dump(char *out) const { return xusd::dump(m_value, out); }
 
-class JsonDouble final : public Value<Json::NUMBER, double> {
-    double number_value() const { return m_value; }
-    int int_value() const { return m_value; }
-    bool equals(const JsonValue * other) const { return m_value == other->number_value(); }
-    bool less(const JsonValue * other)   const { return m_value <  other->number_value(); }
 public:
-    JsonDouble(double value) : Value(value) {}
+    static const Json::Type json_type = tag;
 };
 
-class JsonInt final : public Value<Json::NUMBER, int> {
-    double number_value() const { return m_value; }
-    int int_value() const { return m_value; }
-    bool equals(const JsonValue * other) const { return m_value == other->number_value(); }
-    bool less(const JsonValue * other)   const { return m_value <  other->number_value(); }
+class JsonString : public Value<Json::STRING, string> {
+    const string &string_value() const { return m_value; }
+    string_view string_view_value() const { return m_value; }
+    bool equals(const JsonValue * other) const { return string_view(m_value) == other->string_view_value(); }
+    bool less(const JsonValue * other)   const { return string_view(m_value) <  other->string_view_value(); }
+    size_t measure() const { return remember_dump_size(xusd::dump_size(m_value)); }
 public:
-    JsonInt(double value) : Value(value) {}
+    JsonString(const string &value) : Value(value) {}
+    JsonString(string &&value)      : Value(move(value)) {}
 };
 
-class JsonBoolean final : public Value<Json::BOOL, bool> {
-    bool bool_value() const { return m_value; }
+// A string in the parsed text, see Json::parse_insitu() and
+// Json::parse_borrowed(); m_owner keeps borrowed text alive. string_value()
+// has to hand out a std::string, the first call makes one.
+class JsonStringRef : public JsonValue {
+    const string_view m_value;
+    const std::shared_ptr<const void> m_owner;
+    mutable std::atomic<const string *> m_copy;
+
+    Json::Type type() const { return Json::STRING; }
+    bool equals(const JsonValue * other) const { return m_value == other->string_view_value(); }
+    bool less(const JsonValue * other)   const { return m_value <  other->string_view_value(); }
+    size_t measure() const { return remember_dump_size(xusd::dump_size(m_value)); }
+    char *dump(char *out) const { return xusd::dump(m_value, out); }
+    string_view string_view_value() const { return m_value; }
+    const string &string_value() const {
+        const string *copy = m_copy.load(std::memory_order_acquire);
+        if (copy == nullptr) {
+            const string *mine = new string(m_value.to_string());
+            if (m_copy.compare_exchange_strong(copy, mine, std::memory_order_acq_rel)) {
+                copy = mine;
+            } else {
+                delete mine;
+            }
+        }
+        return *copy;
+    }
 public:
-    JsonBoolean(bool value) : Value(value) {}
-};
+    static const Json::Type json_type = Json::STRING;
 
-class JsonString final : public Value<Json::STRING, string> {
-    const string &string_value() const { return m_value; }
-public:
-    JsonString(const string &value) : Value(value) {}
-    JsonString(string &&value)      : Value(move(value)) {}
+    JsonStringRef(string_view value, std::shared_ptr<const void> owner = nullptr)
+        : m_value(value), m_owner(move(owner)), m_copy(nullptr) {}
+    ~JsonStringRef() { delete m_copy.load(); }
 };
 
-class JsonArray final : public Value<Json::ARRAY, Json::array> {
+class JsonArray : public Value<Json::ARRAY, Json::array> {
+    friend class Json;
     const Json::array &array_items() const { return m_value; }
     const Json & operator[](size_t i) const;
 public:
@@ -176,7 +588,8 @@ public:
     JsonArray(Json::array &&value)      : Value(move(value)) {}
 };
 
-class JsonObject final : public Value<Json::OBJECT, Json::object> {
+class JsonObject : public Value<Json::OBJECT, Json::object> {
+    friend class Json;
     const Json::object &object_items() const { return m_value; }
     const Json & operator[](const string &key) const;
 public:
@@ -184,21 +597,16 @@ public:
     JsonObject(Json::object &&value)      : Value(move(value)) {}
 };
 
-class JsonNull final : public Value<Json::NUL, std::nullptr_t> {
-public:
-    JsonNull() : Value(nullptr) {}
-};
+// Null, booleans and numbers are stored in the Json itself.
+static_assert(sizeof(Json) <= 16, "Json should fit into two machine words");
 
 /* * * * * * * * * * * * * * * * * * * *
  * Static globals - static-init-safe
  */
 struct Statics {
-    const std::shared_ptr<JsonValue> null = make_shared<JsonNull>();
-    const std::shared_ptr<JsonValue> t = make_shared<JsonBoolean>(true);
-    const std::shared_ptr<JsonValue> f = make_shared<JsonBoolean>(false);
     const string empty_string;
     const vector<Json> empty_vector;
-    const map<string, Json> empty_map;
+    const Json::object empty_object;
 };
 
 const Statics & statics() {
@@ -207,48 +615,80 @@ const Statics & statics() {
 }
 
 const Json & static_null() {
-    // This has to be separate, not in Statics, because Json() accesses statics().null.
     static const Json json_null;
     return json_null;
 }
 
+// The empty string, array and object, which all empty values share. They
+// are never freed and their references are not counted.
+template <class T>
+class ImmortalNode final : public T {
+public:
+    template <class... Args>
+    explicit ImmortalNode(Args &&... args) : T(std::forward<Args>(args)...) {
+        this->make_immortal();
+    }
+};
+
+struct EmptyValues {
+    JsonValue * const string;
+    JsonValue * const array;
+    JsonValue * const object;
+};
+
+const EmptyValues & empty_values() {
+    static const EmptyValues v { new ImmortalNode<JsonString>(string()),
+                                 new ImmortalNode<JsonArray>(Json::array()),
+                                 new ImmortalNode<JsonObject>(Json::object()) };
+    return v;
+}
+
 /* * * * * * * * * * * * * * * * * * * *
  * Constructors
  */
 
-Json::Json() noexcept                  : m_ptr(statics().null) {}
-Json::Json(std::nullptr_t) noexcept    : m_ptr(statics().null) {}
-Json::Json(double value)               : m_ptr(make_shared<JsonDouble>(value)) {}
-Json::Json(int value)                  : m_ptr(make_shared<JsonInt>(value)) {}
-Json::Json(bool value)                 : m_ptr(value ? statics().t : statics().f) {}
-Json::Json(const string &value)        : m_ptr(make_shared<JsonString>(value)) {}
-Json::Json(string &&value)             : m_ptr(make_shared<JsonString>(move(value))) {}
-Json::Json(const char * value)         : m_ptr(make_shared<JsonString>(value)) {}
-Json::Json(const Json::array &values)  : m_ptr(make_shared<JsonArray>(values)) {}
-Json::Json(Json::array &&values)       : m_ptr(make_shared<JsonArray>(move(values))) {}
-Json::Json(const Json::object &values) : m_ptr(make_shared<JsonObject>(values)) {}
-Json::Json(Json::object &&values)      : m_ptr(make_shared<JsonObject>(move(values))) {}
+Json::Json(const string &value)
+    : Json(STRING, value.empty() ? empty_values().string : new JsonString(value)) {}
+Json::Json(string &&value)
+    : Json(STRING, value.empty() ? empty_values().string : new JsonString(move(value))) {}
+Json::Json(const char * value)
+    : Json(STRING, *value == '\0' ? empty_values().string : new JsonString(value)) {}
+Json::Json(const Json::array &values)
+    : Json(ARRAY, values.empty() ? empty_values().array : new JsonArray(values)) {}
+Json::Json(Json::array &&values)
+    : Json(ARRAY, values.empty() ? empty_values().array : new JsonArray(move(values))) {}
+Json::Json(const Json::object &values)
+    : Json(OBJECT, values.empty() ? empty_values().object : new JsonObject(values)) {}
+Json::Json(Json::object &&values)
+    : Json(OBJECT, values.empty() ? empty_values().object : new JsonObject(move(values))) {}
 
 /* * * * * * * * * * * * * * * * * * * *
  * Accessors
  */
 
-Json::Type Json::type()                           const { return m_ptr->type();         }
-double Json::number_value()                       const { return m_ptr->number_value(); }
-int Json::int_value()                             const { return m_ptr->int_value();    }
-bool Json::bool_value()                           const { return m_ptr->bool_value();   }
-const string & Json::string_value()               const { return m_ptr->string_value(); }
-const vector<Json> & Json::array_items()          const { return m_ptr->array_items();  }
-const map<string, Json> & Json::object_items()    const { return m_ptr->object_items(); }
-const Json & Json::operator[] (size_t i)          const { return (*m_ptr)[i];           }
-const Json & Json::operator[] (const string &key) const { return (*m_ptr)[key];         }
-
-double                    JsonValue::number_value()              const { return 0; }
-int                       JsonValue::int_value()                 const { return 0; }
-bool                      JsonValue::bool_value()                const { return false; }
+const string & Json::string_value() const {
+    return has_value() ? m_ptr->string_value() : statics().empty_string;
+}
+string_view Json::string_view_value() const {
+    return has_value() ? m_ptr->string_view_value() : string_view();
+}
+const vector<Json> & Json::array_items() const {
+    return has_value() ? m_ptr->array_items() : statics().empty_vector;
+}
+const Json::object & Json::object_items() const {
+    return has_value() ? m_ptr->object_items() : statics().empty_object;
+}
+const Json & Json::operator[] (size_t i) const {
+    return has_value() ? (*m_ptr)[i] : static_null();
+}
+const Json & Json::operator[] (const string &key) const {
+    return has_value() ? (*m_ptr)[key] : static_null();
+}
+
 const string &            JsonValue::string_value()              const { return statics().empty_string; }
+string_view               JsonValue::string_view_value()         const { return string_view(); }
 const vector<Json> &      JsonValue::array_items()               const { return statics().empty_vector; }
-const map<string, Json> & JsonValue::object_items()              const { return statics().empty_map; }
+const Json::object &      JsonValue::object_items()              const { return statics().empty_object; }
 const Json &              JsonValue::operator[] (size_t)         const { return static_null(); }
 const Json &              JsonValue::operator[] (const string &) const { return static_null(); }
 
@@ -256,6 +696,7 @@ const Json & JsonObject::operator[] (const string &key) const {
     auto iter = m_value.find(key);
     return (iter == m_value.end()) ? static_null() : iter->second;
 }
+
 const Json & JsonArray::operator[] (size_t i) const {
     if (i >= m_value.size()) {
         return static_null();
@@ -265,189 +706,854 @@ const Json & JsonArray::operator[] (size_t i) const {
 }
 
 /* * * * * * * * * * * * * * * * * * * *
- * Comparison
+ * Modifiers
+ *
+ * A node only this Json refers to is changed in place, a shared one is
+ * replaced by a copy that shares the elements. Shared includes the empty
+ * array and object all empty values refer to.
  */
 
-bool Json::operator== (const Json &other) const {
-    if (m_ptr->type() != other.m_ptr->type())
-        return false;
+Json::array & Json::mutable_array() {
+    if (m_kind != K_NULL && m_kind != K_ARRAY)
+        throw std::domain_error("Json: not an array");
+    if (m_kind == K_NULL || m_ptr->shared())
+        *this = Json(ARRAY, new JsonArray(array_items()));
+    return static_cast<JsonArray *>(m_ptr)->m_value;
+}
 
-    return m_ptr->equals(other.m_ptr.get());
+Json::object & Json::mutable_object() {
+    if (m_kind != K_NULL && m_kind != K_OBJECT)
+        throw std::domain_error("Json: not an object");
+    if (m_kind == K_NULL || m_ptr->shared())
+        *this = Json(OBJECT, new JsonObject(object_items()));
+    return static_cast<JsonObject *>(m_ptr)->m_value;
 }
 
-bool Json::operator< (const Json &other) const {
-    if (m_ptr->type() != other.m_ptr->type())
-        return m_ptr->type() < other.m_ptr->type();
+Json & Json::operator[] (size_t i) {
+    array &items = mutable_array();
+    if (i >= items.size())
+        items.resize(i + 1);
+    return items[i];
+}
 
-    return m_ptr->less(other.m_ptr.get());
+Json & Json::operator[] (const string &key) {
+    return mutable_object()[key];
 }
 
-/* JsonParser
- *
- * Object that tracks all state of an in-progress parse.
+void Json::push_back(Json value) {
+    mutable_array().push_back(move(value));
+}
+
+size_t Json::erase(string_view key) {
+    return is_null() ? 0 : mutable_object().erase(key);
+}
+
+void Json::erase(size_t i) {
+    if (is_null())
+        return;
+    array &items = mutable_array();
+    if (i < items.size())
+        items.erase(items.begin() + i);
+}
+
+/* * * * * * * * * * * * * * * * * * * *
+ * Object members
  */
-class JsonParser {
-    const std::string& json_str;
 
-public:
-    JsonParser(const std::string& in):json_str(in) {
-        jsonparse_setup(&__state, json_str.data(), json_str.size());
-    }
-    /* State
-     */
-    struct jsonparse_state __state;
+// Up to this many members a linear scan, which compares lengths first,
+// beats binary search.
+static const size_t object_linear_search = 8;
+// From this many members on, keys are hashed and looked up through an index.
+static const size_t object_hash_search = 128;
 
+static bool key_less(const object_map::value_type &member, string_view key) {
+    return member.first.view() < key;
+}
 
-    bool isFailed() {
-        return __state.error != JSON_ERROR_OK;
+// FNV-1a
+static uint32_t key_hash(string_view key) {
+    uint32_t hash = 2166136261u;
+    for (char ch : key) {
+        hash ^= (uint8_t)ch;
+        hash *= 16777619u;
     }
+    return hash;
+}
 
-    string& failMsg(string &err) {
-        err.clear();
-        switch (__state.error) {
-            case JSON_ERROR_OK:
-                break;
-            case JSON_ERROR_SYNTAX:
-                err = "syntax error near: \n";
-                break;
-            case JSON_ERROR_UNEXPECTED_ARRAY:
-                err = "unexpected array near: \n";
-                break;
-            case JSON_ERROR_UNEXPECTED_END_OF_ARRAY:
-                err = "unexpected end of array near: \n";
-                break;
-            case JSON_ERROR_UNEXPECTED_OBJECT:
-                err = "unexpected object near: \n";
-                break;
-            case JSON_ERROR_UNEXPECTED_STRING:
-                err = "unexpected string near: \n";
-                break;
-            case JSON_ERROR_MAXDEPTH:
-                err = "unexpected string near: \n";
-                break;
-        }
-
-        const char* s = __state.json + __state.pos;
-        const char* e = (__state.pos + 64) < __state.len ? (__state.json + __state.pos + 64) : (__state.json + __state.len);
-        for (int i =0; i < 64; ++i) {
-            s = __state.json + __state.pos - i;
-            if ((s <= __state.json)) {
-                break;
-            }
-            if (*s == '\n') {
-                if ((__state.json + __state.pos - s) > 32) {
-                    break;
-                }
-            }
-        }
-        for (int i =0; i < 64; ++i) {
-            e = __state.json + __state.pos + i;
-            if ((e >= __state.json + __state.len) || (*e == '\n')) {
-                break;
-            }
-        }
-        int pos = __state.json + __state.pos - s;
-        err.append(s, e);
-        err.append("\n");
-        err.append(pos/2, ' ');
-        err.append(pos/2, '_');
-        err.append("^\n");
-        return err;
+object_key::object_key(string_view text) {
+    if (text.size() <= max_inline) {
+        clear();
+        std::memcpy(m_text, text.data(), text.size());
+        m_text[max_inline] = max_inline - text.size();
+    } else {
+        m_word[0] = m_word[1] = 0;
+        m_atom = atom::make(text, key_hash(text), 1);
+        m_text[max_inline] = atom_tag;
     }
+}
 
-    /* encode_utf8(pt, out)
-     *
-     * Encode pt as UTF-8 and add it to out.
-     */
-    void encode_utf8(long pt, string & out) {
-        if (pt < 0)
-            return;
+uint32_t object_key::hash() const {
+    return is_inline() ? key_hash(view()) : m_atom->hash;
+}
 
-        if (pt < 0x80) {
-            out += pt;
-        } else if (pt < 0x800) {
-            out += (pt >> 6) | 0xC0;
-            out += (pt & 0x3F) | 0x80;
-        } else if (pt < 0x10000) {
-            out += (pt >> 12) | 0xE0;
-            out += ((pt >> 6) & 0x3F) | 0x80;
-            out += (pt & 0x3F) | 0x80;
-        } else {
-            out += (pt >> 18) | 0xF0;
-            out += ((pt >> 12) & 0x3F) | 0x80;
-            out += ((pt >> 6) & 0x3F) | 0x80;
-            out += (pt & 0x3F) | 0x80;
+object_key::atom *object_key::atom::make(string_view text, uint32_t hash, long refs) {
+    void *memory = ::operator new(sizeof(atom) + text.size() + 1);
+    atom *made = new (memory) atom(text.size(), hash, refs);
+    char *chars = reinterpret_cast<char *>(made + 1);
+    std::memcpy(chars, text.data(), text.size());
+    chars[text.size()] = '\0';
+    return made;
+}
+
+void object_key::atom::release() {
+    if (refs.release()) {
+        this->~atom();
+        ::operator delete(this);
+    }
+}
+
+/* KeyPool
+ *
+ * Interns the keys too long to be stored inline: one atom per distinct
+ * key, found through an open addressing table that holds a reference to
+ * each. Only one thread uses a pool, the keys it hands out may go to any
+ * thread.
+ */
+class KeyPool {
+    typedef object_key::atom atom;
+
+    vector<atom *> slots;
+    size_t count;
+    const size_t max_count;
+    const size_t max_length;
+
+    void grow() {
+        vector<atom *> old(std::max<size_t>(16, 2 * slots.size()), nullptr);
+        old.swap(slots);
+        const size_t mask = slots.size() - 1;
+        for (atom *shared : old) {
+            if (shared) {
+                size_t i = shared->hash & mask;
+                while (slots[i])
+                    i = (i + 1) & mask;
+                slots[i] = shared;
+            }
         }
     }
 
-    /* parse_string()
-     *
-     * Parse a string, starting at the current position.
-     */
-    string parse_string() {
-        return std::string(__state.json + __state.vstart, __state.vlen);
+public:
+    KeyPool(size_t max_count, size_t max_length)
+        : count(0), max_count(max_count), max_length(max_length) {}
+    ~KeyPool() {
+        for (atom *shared : slots)
+            if (shared)
+                shared->release();
     }
+    KeyPool(const KeyPool &) = delete;
+    KeyPool &operator=(const KeyPool &) = delete;
 
-    /* parse_number()
+    /* intern(text)
      *
-     * Parse a double.
+     * The key with text, shared if the pool has it or has room for it.
      */
-    Json parse_number() {
-        size_t i = 0;
-        const char* str = __state.json + __state.vstart;
-
-        if (str[i] == '-')
-            i++;
-
-        // Integer part
-        if (str[i] == '0') {
-            i++;
-            if (str[i] >= '0' && str[i] <='9') {
-                __state.error = JSON_ERROR_SYNTAX;
-                return Json();
+    object_key intern(string_view text) {
+        if (text.size() <= object_key::max_inline)
+            return object_key(text);
+        const uint32_t hash = key_hash(text);
+        if (text.size() > max_length)
+            return object_key(atom::make(text, hash, 1));
+        if (2 * (count + 1) > slots.size())
+            grow();
+        const size_t mask = slots.size() - 1;
+        size_t i = hash & mask;
+        for (; slots[i]; i = (i + 1) & mask) {
+            atom *shared = slots[i];
+            if (shared->hash == hash && string_view(shared->chars(), shared->size) == text) {
+                shared->refs.retain();
+                return object_key(shared);
             }
-        } else if (str[i] >= '1' && str[i] <='9') {
-            i++;
-            while (str[i] >= '0' && str[i] <='9')
-                i++;
-        } else {
-                __state.error = JSON_ERROR_SYNTAX;
-                return Json();
         }
+        if (count == max_count)
+            return object_key(atom::make(text, hash, 1));
+        slots[i] = atom::make(text, hash, 2);
+        ++count;
+        return object_key(slots[i]);
+    }
+};
 
-        if (str[i] != '.' && str[i] != 'e' && str[i] != 'E'
-                && i <= (size_t)std::numeric_limits<int>::digits10) {
-            return std::atoi(str);
-        }
+static KeyPool &thread_keys() {
+    static thread_local KeyPool pool(1 << 16, 256);
+    return pool;
+}
 
-        // Decimal part
-        if (str[i] == '.') {
-            i++;
-            if (!(str[i] >= '0' && str[i] <='9')) {
-                __state.error = JSON_ERROR_SYNTAX;
-                return Json();
+/* object_map::hash_index
+ *
+ * The hashes of the keys in member order, and an open addressing table of
+ * member positions plus one, 0 for a free slot, at most half full. The
+ * first lookup builds the table; racing lookups may both build it, one of
+ * them wins.
+ */
+struct object_map::hash_index {
+    vector<uint32_t> hashes;
+    std::atomic<uint32_t *> slots;
+    uint32_t mask;
+
+    explicit hash_index(const vector<value_type> &members) : slots(nullptr) {
+        hashes.reserve(members.size());
+        for (const value_type &member : members)
+            hashes.push_back(member.first.hash());
+        resized();
+    }
+    hash_index(const hash_index &other) : hashes(other.hashes), slots(nullptr), mask(other.mask) {}
+    ~hash_index() { delete[] slots.load(); }
+
+    // A member was inserted at position i, or the one there erased. The
+    // positions after it move up or down by one in the table, and its own
+    // slot is filled or emptied in place. A table that would be more than
+    // half full is dropped, and the next lookup builds one twice the size.
+    void inserted(size_t i, uint32_t hash) {
+        hashes.insert(hashes.begin() + i, hash);
+        uint32_t *table = slots.load(std::memory_order_relaxed);
+        if (table == nullptr || 2 * hashes.size() > mask + size_t(1)) {
+            delete[] slots.exchange(nullptr);
+            resized();
+            return;
+        }
+        for (uint32_t slot = 0; slot <= mask; ++slot)
+            if (table[slot] > i)
+                ++table[slot];
+        uint32_t slot = hash & mask;
+        while (table[slot])
+            slot = (slot + 1) & mask;
+        table[slot] = i + 1;
+    }
+    void erased(size_t i) {
+        const uint32_t hash = hashes[i];
+        hashes.erase(hashes.begin() + i);
+        uint32_t *table = slots.load(std::memory_order_relaxed);
+        if (table == nullptr) {
+            resized();
+            return;
+        }
+        uint32_t hole = hash & mask;
+        while (table[hole] != i + 1)
+            hole = (hole + 1) & mask;
+        table[hole] = 0;
+        for (uint32_t slot = 0; slot <= mask; ++slot)
+            if (table[slot] > i)
+                --table[slot];
+        // Members further along the probe sequence that may sit in the
+        // hole move into it, so that no lookup stops short of them.
+        for (uint32_t slot = (hole + 1) & mask; table[slot]; slot = (slot + 1) & mask) {
+            const uint32_t home = hashes[table[slot] - 1] & mask;
+            if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+                table[hole] = table[slot];
+                table[slot] = 0;
+                hole = slot;
             }
-
-            while (str[i] >= '0' && str[i] <='9') { i++; }
         }
+    }
 
-        // Exponent part
-        if (str[i] == 'e' || str[i] == 'E') {
-            i++;
-
-            if (str[i] == '+' || str[i] == '-')
-                i++;
+    // Size the table for the hashes, while there is none.
+    void resized() {
+        size_t size = 16;
+        while (size < 2 * hashes.size())
+            size *= 2;
+        mask = size - 1;
+    }
 
-            if (!(str[i] >= '0' && str[i] <= '9')) {
-                __state.error = JSON_ERROR_SYNTAX;
-                return Json();
+    const uint32_t *table() {
+        uint32_t *table = slots.load(std::memory_order_acquire);
+        if (table == nullptr) {
+            uint32_t *mine = new uint32_t[mask + 1]();
+            for (size_t i = 0; i < hashes.size(); ++i) {
+                uint32_t slot = hashes[i] & mask;
+                while (mine[slot])
+                    slot = (slot + 1) & mask;
+                mine[slot] = i + 1;
+            }
+            if (slots.compare_exchange_strong(table, mine, std::memory_order_acq_rel)) {
+                table = mine;
+            } else {
+                delete[] mine;
             }
-
-            while (str[i] >= '0' && str[i] <='9')
-                i++;
         }
-
-        return std::atof(str);
+        return table;
+    }
+};
+
+object_map::object_map(const object_map &other)
+    : m_members(other.m_members), m_index(other.m_index ? new hash_index(*other.m_index) : nullptr) {}
+
+object_map::object_map(object_map &&other) noexcept
+    : m_members(move(other.m_members)), m_index(other.m_index) {
+    other.m_index = nullptr;
+}
+
+object_map &object_map::operator=(object_map other) noexcept {
+    m_members.swap(other.m_members);
+    std::swap(m_index, other.m_index);
+    return *this;
+}
+
+object_map::~object_map() {
+    delete m_index;
+}
+
+object_map::const_iterator object_map::find(string_view key) const {
+    if (m_index)
+        return find_hashed(key);
+    if (m_members.size() <= object_linear_search) {
+        for (auto it = m_members.begin(); it != m_members.end(); ++it)
+            if (it->first == key)
+                return it;
+        return m_members.end();
+    }
+    auto it = std::lower_bound(m_members.begin(), m_members.end(), key, key_less);
+    return (it != m_members.end() && it->first == key) ? it : m_members.end();
+}
+
+object_map::const_iterator object_map::find_hashed(string_view key) const {
+    const uint32_t *table = m_index->table();
+    const uint32_t hash = key_hash(key);
+    for (uint32_t slot = hash & m_index->mask; table[slot]; slot = (slot + 1) & m_index->mask) {
+        const uint32_t i = table[slot] - 1;
+        if (m_index->hashes[i] == hash && m_members[i].first == key)
+            return m_members.begin() + i;
+    }
+    return m_members.end();
+}
+
+const Json & object_map::at(string_view key) const {
+    auto it = find(key);
+    if (it == m_members.end())
+        throw std::out_of_range("object_map::at");
+    return it->second;
+}
+
+Json & object_map::operator[] (const string &key) {
+    auto it = lower_bound(key);
+    if (it == m_members.end() || it->first != key) {
+        it = m_members.emplace(it, key, Json());
+        inserted(it - m_members.begin());
+    }
+    return it->second;
+}
+
+std::pair<object_map::const_iterator, bool> object_map::insert(value_type member) {
+    auto it = lower_bound(member.first.view());
+    if (it != m_members.end() && it->first == member.first)
+        return { it, false };
+    it = m_members.insert(it, move(member));
+    inserted(it - m_members.begin());
+    return { it, true };
+}
+
+size_t object_map::erase(string_view key) {
+    auto it = lower_bound(key);
+    if (it == m_members.end() || it->first != key)
+        return 0;
+    const size_t i = it - m_members.begin();
+    m_members.erase(it);
+    if (m_index)
+        m_index->erased(i);
+    return 1;
+}
+
+void object_map::clear() {
+    m_members.clear();
+    changed();
+}
+
+vector<object_map::value_type>::iterator object_map::lower_bound(string_view key) {
+    return std::lower_bound(m_members.begin(), m_members.end(), key, key_less);
+}
+
+/* prepare(keep_last)
+ *
+ * Sort the members by key and drop repeated keys, in one pass for
+ * members that are sorted already, then hash the keys if there are
+ * enough of them.
+ */
+void object_map::prepare(bool keep_last) {
+    auto strictly_less = [](const value_type &a, const value_type &b) { return a.first < b.first; };
+    auto not_less = [&](const value_type &a, const value_type &b) { return !strictly_less(a, b); };
+    if (std::adjacent_find(m_members.begin(), m_members.end(), not_less) != m_members.end()) {
+        std::stable_sort(m_members.begin(), m_members.end(), strictly_less);
+
+        auto out = m_members.begin();
+        for (auto it = m_members.begin(); it != m_members.end(); ) {
+            auto run = it + 1;
+            while (run != m_members.end() && run->first == it->first)
+                ++run;
+            auto keep = keep_last ? run - 1 : it;
+            if (out != keep)
+                *out = move(*keep);
+            ++out;
+            it = run;
+        }
+        m_members.erase(out, m_members.end());
+    }
+    changed();
+}
+
+/* changed()
+ *
+ * Hash all the keys again after the members were replaced.
+ */
+void object_map::changed() {
+    delete m_index;
+    m_index = nullptr;
+    if (m_members.size() >= object_hash_search)
+        m_index = new hash_index(m_members);
+}
+
+/* inserted(i)
+ *
+ * Hash the key of the member just inserted at position i, or all of them
+ * once there are enough.
+ */
+void object_map::inserted(size_t i) {
+    if (m_index)
+        m_index->inserted(i, m_members[i].first.hash());
+    else if (m_members.size() >= object_hash_search)
+        m_index = new hash_index(m_members);
+}
+
+
+/* * * * * * * * * * * * * * * * * * * *
+ * Comparison
+ *
+ * Integers of any width compare exactly, other numbers as double.
+ */
+
+bool Json::operator== (const Json &other) const {
+    const Type t = type();
+    if (t != other.type())
+        return false;
+
+    switch (t) {
+        case NUL:
+            return true;
+        case BOOL:
+            return m_bool == other.m_bool;
+        case NUMBER:
+            if (m_kind == K_DOUBLE || other.m_kind == K_DOUBLE)
+                return number_value() == other.number_value();
+            if (m_kind != other.m_kind && (m_kind == K_INT ? m_int : other.m_int) < 0)
+                return false;
+            return m_uint == other.m_uint;
+        default:
+            return m_ptr == other.m_ptr || m_ptr->equals(other.m_ptr);
+    }
+}
+
+bool Json::operator< (const Json &other) const {
+    const Type t = type();
+    if (t != other.type())
+        return t < other.type();
+
+    switch (t) {
+        case NUL:
+            return false;
+        case BOOL:
+            return m_bool < other.m_bool;
+        case NUMBER:
+            if (m_kind == K_DOUBLE || other.m_kind == K_DOUBLE)
+                return number_value() < other.number_value();
+            if (m_kind == other.m_kind)
+                return m_kind == K_INT ? m_int < other.m_int : m_uint < other.m_uint;
+            if (m_kind == K_INT)
+                return m_int < 0 || m_uint < other.m_uint;
+            return other.m_int >= 0 && m_uint < other.m_uint;
+        default:
+            return m_ptr != other.m_ptr && m_ptr->less(other.m_ptr);
+    }
+}
+
+/* Arena
+ *
+ * Bump allocator for the nodes and strings of one parsed document, see
+ * Json::PARSE_ARENA. Every node holds a reference to it, the chunks are
+ * freed together when the last one is released.
+ */
+class Arena {
+    struct Chunk {
+        Chunk *next;
+    };
+    Chunk *chunks;
+    uintptr_t cur;
+    uintptr_t end;
+    size_t next_size;
+    ref_count refs;
+
+    ~Arena() {
+        while (chunks) {
+            Chunk *next = chunks->next;
+            ::operator delete(chunks);
+            chunks = next;
+        }
+    }
+
+    void grow(size_t size) {
+        size = std::max(next_size, size + sizeof(Chunk));
+        Chunk *chunk = static_cast<Chunk *>(::operator new(size));
+        chunk->next = chunks;
+        chunks = chunk;
+        cur = reinterpret_cast<uintptr_t>(chunk + 1);
+        end = reinterpret_cast<uintptr_t>(chunk) + size;
+        next_size = std::min<size_t>(next_size * 2, 1 << 20);
+    }
+
+public:
+    Arena() : chunks(nullptr), cur(0), end(0), next_size(16 * 1024), refs(1) {}
+
+    /* allocate(size, align)
+     *
+     * Only the parser allocates, so this needs no synchronization.
+     */
+    void *allocate(size_t size, size_t align) {
+        uintptr_t p = (cur + align - 1) & ~(uintptr_t)(align - 1);
+        if (chunks == nullptr || p + size > end) {
+            grow(size + align);
+            p = (cur + align - 1) & ~(uintptr_t)(align - 1);
+        }
+        cur = p + size;
+        return reinterpret_cast<void *>(p);
+    }
+
+    void retain() {
+        refs.retain();
+    }
+    void release() {
+        if (refs.release())
+            delete this;
+    }
+};
+
+/* ArenaNode<T>
+ *
+ * A node placed in an arena, which releases its reference to the arena
+ * instead of freeing its memory.
+ */
+template <class T>
+class ArenaNode final : public T {
+    Arena * const m_arena;
+
+    void destroy() {
+        Arena *arena = m_arena;
+        this->~ArenaNode();
+        arena->release();
+    }
+public:
+    template <class... Args>
+    ArenaNode(Arena *arena, Args &&... args) : T(std::forward<Args>(args)...), m_arena(arena) {
+        arena->retain();
+    }
+};
+
+/* ParseInput
+ *
+ * The text to parse and where the tree goes, see the Json::parse variants.
+ */
+struct ParseInput {
+    const char *json;
+    size_t len;
+    /* the buffer strings are decoded in, null to copy them instead */
+    char *insitu;
+    /* set if strings may borrow from the text */
+    std::shared_ptr<const void> owner;
+    /* set to place the nodes in an arena instead of the heap */
+    bool arena;
+    /* set to intern keys in the pool of the thread */
+    bool intern_keys;
+};
+
+/* JsonParser
+ *
+ * Object that tracks all state of an in-progress parse.
+ */
+class JsonParser {
+    char * const insitu;
+    const std::shared_ptr<const void> owner;
+    Arena * const arena;
+    KeyPool * const keys;
+
+public:
+    JsonParser(const ParseInput &in)
+        : insitu(in.insitu), owner(in.owner), arena(in.arena ? new Arena : nullptr),
+          keys(in.intern_keys ? &thread_keys() : nullptr) {
+        jsonparse_setup(&__state, in.json, in.len);
+    }
+    ~JsonParser() {
+        if (arena)
+            arena->release();
+    }
+    JsonParser(const JsonParser &) = delete;
+    JsonParser &operator=(const JsonParser &) = delete;
+    /* State
+     */
+    struct jsonparse_state __state;
+
+    /* Members of the objects being parsed, the innermost one last. They
+     * are moved into the object once it is complete, so it is allocated
+     * once and at its size.
+     */
+    vector<Json::object::value_type> members;
+
+    /* The nodes of short strings, by a hash of their text. Strings this
+     * short are kept inside the node already, and repeated ones (statuses,
+     * codes, flags) share it. Each text has two slots, replaced in turn
+     * (hand of the first slot); a node that was shared survives one
+     * string that would replace it, so unique strings do not push out the
+     * repeated ones. Documents with few short strings do without.
+     */
+    struct ShortString {
+        string_view text;
+        Json node;
+        bool reused = false;
+        unsigned char hand = 0;
+    };
+    static const size_t short_string_max = 15;
+    static const size_t short_string_slots = 64;
+    std::unique_ptr<ShortString[]> short_strings;
+    size_t short_string_count = 0;
+
+    Json make_object(size_t first) {
+        if (members.size() == first)
+            return Json(Json::OBJECT, empty_values().object);
+        vector<Json::object::value_type> data(std::make_move_iterator(members.begin() + first),
+                                              std::make_move_iterator(members.end()));
+        members.erase(members.begin() + first, members.end());
+        return make<JsonObject>(Json::object(move(data)));
+    }
+
+
+    Json make_array(vector<Json> &&items) {
+        if (items.empty())
+            return Json(Json::ARRAY, empty_values().array);
+        return make<JsonArray>(move(items));
+    }
+
+    /* make<T>(args...)
+     *
+     * A new node, in the arena if there is one.
+     */
+    template <class T, class... Args>
+    Json make(Args &&... args) {
+        if (arena) {
+            void *node = arena->allocate(sizeof(ArenaNode<T>), alignof(ArenaNode<T>));
+            return Json(T::json_type, new (node) ArenaNode<T>(arena, std::forward<Args>(args)...));
+        }
+        return Json(T::json_type, new T(std::forward<Args>(args)...));
+    }
+
+    bool isFailed() {
+        return __state.error != JSON_ERROR_OK;
+    }
+
+    string& failMsg(string &err) {
+        err.clear();
+        switch (__state.error) {
+            case JSON_ERROR_OK:
+                break;
+            case JSON_ERROR_SYNTAX:
+                err = "syntax error near: \n";
+                break;
+            case JSON_ERROR_UNEXPECTED_ARRAY:
+                err = "unexpected array near: \n";
+                break;
+            case JSON_ERROR_UNEXPECTED_END_OF_ARRAY:
+                err = "unexpected end of array near: \n";
+                break;
+            case JSON_ERROR_UNEXPECTED_OBJECT:
+                err = "unexpected object near: \n";
+                break;
+            case JSON_ERROR_UNEXPECTED_STRING:
+                err = "unexpected string near: \n";
+                break;
+            case JSON_ERROR_MAXDEPTH:
+                err = "unexpected string near: \n";
+                break;
+        }
+
+        /* the tokenizer may have stepped past the end of the text */
+        const char* at = __state.json + std::min(__state.pos, __state.len);
+        const char* end = __state.json + __state.len;
+        const char* s = at;
+        const char* e = at;
+        for (int i =0; i < 64; ++i) {
+            s = at - i;
+            if ((s <= __state.json)) {
+                break;
+            }
+            if (s < end && *s == '\n') {
+                if ((at - s) > 32) {
+                    break;
+                }
+            }
+        }
+        for (int i =0; i < 64; ++i) {
+            e = at + i;
+            if ((e >= end) || (*e == '\n')) {
+                break;
+            }
+        }
+        jsonparse_offset_t pos = at - s;
+        err.append(s, e);
+        err.append("\n");
+        err.append(pos/2, ' ');
+        err.append(pos/2, '_');
+        err.append("^\n");
+        return err;
+    }
+
+    /* parse_text(start, len)
+     *
+     * The string with the body json[start, start + len), escapes decoded.
+     */
+    string parse_text(jsonparse_offset_t start, jsonparse_offset_t len) {
+        if (insitu) {
+            string_view body = unescape_insitu(start, len);
+            return string(body.data(), body.size());
+        }
+        const char *body = __state.json + start;
+        if (std::memchr(body, '\\', len) == nullptr)
+            return string(body, len);
+        string out(len, '\0');
+        len = jsonparse_unescape(body, len, &out[0]);
+        if (len < 0) {
+            __state.error = JSON_ERROR_SYNTAX;
+            __state.pos = start;
+            return string();
+        }
+        out.resize(len);
+        return out;
+    }
+
+    /* parse_key(start, len)
+     *
+     * Like parse_text(), but as a key, interned if requested.
+     */
+    object_key parse_key(jsonparse_offset_t start, jsonparse_offset_t len) {
+        if (insitu)
+            return make_key(unescape_insitu(start, len));
+        const char *body = __state.json + start;
+        if (std::memchr(body, '\\', len) == nullptr)
+            return make_key(string_view(body, len));
+        return make_key(parse_text(start, len));
+    }
+
+    object_key make_key(string_view text) {
+        return keys ? keys->intern(text) : object_key(text);
+    }
+
+    /* parse_string(start, len)
+     *
+     * The string value with the body json[start, start + len). Empty
+     * strings share one node, and so do short strings without escapes
+     * that already occurred in the document; see make_string() for the
+     * others.
+     */
+    Json parse_string(jsonparse_offset_t start, jsonparse_offset_t len) {
+        if (len == 0)
+            return Json(Json::STRING, empty_values().string);
+        const char *body = __state.json + start;
+        if ((size_t)len > short_string_max || std::memchr(body, '\\', len) != nullptr)
+            return make_string(start, len);
+        if (!short_strings) {
+            if (++short_string_count < short_string_slots)
+                return make_string(start, len);
+            short_strings.reset(new ShortString[short_string_slots]);
+        }
+        const string_view text(body, len);
+        ShortString *set = &short_strings[key_hash(text) % short_string_slots & ~(size_t)1];
+        for (int i = 0; i < 2; ++i) {
+            if (set[i].node.is_string() && set[i].text == text) {
+                set[i].reused = true;
+                return set[i].node;
+            }
+        }
+        Json node = make_string(start, len);
+        unsigned char &hand = set[0].hand;
+        for (int i = 0; i < 2; ++i) {
+            ShortString &entry = set[hand];
+            hand ^= 1;
+            if (!entry.reused) {
+                entry.text = node.string_view_value();
+                entry.node = node;
+                break;
+            }
+            entry.reused = false;
+        }
+        return node;
+    }
+
+    /* make_string(start, len)
+     *
+     * Like parse_text(), but in situ the node refers to the decoded body
+     * and borrowed strings without escapes refer to the text itself,
+     * unless they are short enough not to need an allocation and there is
+     * an owner to keep alive. With an arena the body is decoded into it.
+     */
+    Json make_string(jsonparse_offset_t start, jsonparse_offset_t len) {
+        /* short strings live inside the std::string anyway */
+        static const size_t inline_capacity = string().capacity();
+        if (insitu) {
+            string_view body = unescape_insitu(start, len);
+            if (isFailed())
+                return Json();
+            if (owner && body.size() <= inline_capacity)
+                return make<JsonString>(body.to_string());
+            return make<JsonStringRef>(body, owner);
+        }
+        const char *body = __state.json + start;
+        if (owner && (size_t)len > inline_capacity && std::memchr(body, '\\', len) == nullptr)
+            return make<JsonStringRef>(string_view(body, len), owner);
+        if (arena) {
+            char *copy = static_cast<char *>(arena->allocate(len, 1));
+            len = jsonparse_unescape(body, len, copy);
+            if (len < 0) {
+                __state.error = JSON_ERROR_SYNTAX;
+                __state.pos = start;
+                return Json();
+            }
+            return make<JsonStringRef>(string_view(copy, len));
+        }
+        return make<JsonString>(parse_text(start, len));
+    }
+
+    string_view unescape_insitu(jsonparse_offset_t start, jsonparse_offset_t len) {
+        len = jsonparse_unescape(insitu + start, len, insitu + start);
+        if (len < 0) {
+            __state.error = JSON_ERROR_SYNTAX;
+            __state.pos = start;
+            return string_view();
+        }
+        return string_view(insitu + start, len);
+    }
+
+    /* parse_number()
+     *
+     * Parse the number token at vstart, exact and independent of the
+     * locale. Integers are kept exactly as int64_t, or as uint64_t if
+     * they only fit that.
+     */
+    Json parse_number() {
+        struct jsonnumber num;
+        if (jsonnumber_parse(__state.json + __state.vstart, __state.vlen, &num) != __state.vlen) {
+            __state.error = JSON_ERROR_SYNTAX;
+            return Json();
+        }
+
+        if (num.integer && !num.negative) {
+            if (num.mantissa <= (uint64_t)std::numeric_limits<int64_t>::max())
+                return Json((int64_t)num.mantissa);
+            return Json(num.mantissa);
+        }
+        if (num.integer && num.mantissa - 1 <= (uint64_t)std::numeric_limits<int64_t>::max())
+            return Json(-(int64_t)(num.mantissa - 1) - 1);
+        return Json(num.value);
     }
 
     /* parse_json()
@@ -462,17 +1568,15 @@ public:
             __state.error = JSON_ERROR_MAXDEPTH;
             return Json();
         }
+        return parse_token(jsonparse_next(&__state));
+    }
 
-        int n = 0;
-        if (__state.vtype == 0) {
-            n = jsonparse_next(&__state);
-        } else {
-            n = __state.vtype;
-        }
-        if (n == JSON_TYPE_ERROR) {
-            return Json();
-        }
-
+    /* parse_token(n)
+     *
+     * Parse the value starting with the token n, already returned by
+     * jsonparse_next().
+     */
+    Json parse_token(int n) {
         switch (n) {
             case JSON_TYPE_NUMBER:
                 return parse_number();
@@ -483,10 +1587,10 @@ public:
             case JSON_TYPE_NULL:
                 return nullptr;
             case JSON_TYPE_STRING:
-                return string(__state.json + __state.vstart, __state.vlen);
+                return parse_string(__state.vstart, __state.vlen);
             case JSON_TYPE_OBJECT:
                 {
-                    map<string, Json> data;
+                    const size_t first = members.size();
 
                     while (true) {
                         int ch = jsonparse_next(&__state);
@@ -503,15 +1607,22 @@ public:
                             __state.error = JSON_ERROR_UNEXPECTED_OBJECT;
                             return Json();
                         }
-                        string key(__state.json + __state.vstart, __state.vlen);
+                        object_key key = parse_key(__state.vstart, __state.vlen);
+                        if (isFailed()) {
+                            return Json();
+                        }
                         ch = jsonparse_next(&__state);
                         if (ch != ':') {
                             __state.error = JSON_ERROR_UNEXPECTED_OBJECT;
                             return Json();
                         }
-                        data[key] = parse_json();
+                        Json value = parse_json();
+                        if (isFailed()) {
+                            return Json();
+                        }
+                        members.emplace_back(move(key), move(value));
                     }
-                    return data;
+                    return make_object(first);
                 }
                 break;
             case JSON_TYPE_ARRAY:
@@ -528,9 +1639,12 @@ public:
                         if (ch == ',') {
                             continue;
                         }
-                        data.push_back(parse_json());
+                        data.push_back(parse_token(ch));
+                        if (isFailed()) {
+                            return Json();
+                        }
                     }
-                    return data;
+                    return make_array(move(data));
                 }
                 break;
             case JSON_TYPE_PAIR_NAME:
@@ -541,8 +1655,438 @@ public:
     }
 };
 
-Json Json::parse(const string &in, string &err) {
-    JsonParser parser(in);
+/* JsonIndexParser
+ *
+ * Second stage of the structural index backend: builds the tree by walking
+ * the offsets found by jsonindex_next() instead of asking jsonparse_next()
+ * for every token. The input is indexed one window at a time, so memory
+ * stays bounded for any document size.
+ */
+class JsonIndexParser : public JsonParser {
+    static const jsonparse_offset_t window = 16 * 1024;
+
+    struct jsonindex_state stage1;
+    std::unique_ptr<jsonparse_offset_t[]> index;
+    jsonparse_offset_t count;
+    jsonparse_offset_t cur;
+    /* where a value directly behind a number or literal starts, or 0 */
+    jsonparse_offset_t rest;
+
+    /* fail(error, offset)
+     *
+     * Record an error at offset the way failMsg() expects it.
+     */
+    Json fail(char error, jsonparse_offset_t offset) {
+        __state.error = error;
+        __state.pos = std::min(offset + 1, __state.len);
+        return Json();
+    }
+
+    /* fill()
+     *
+     * Make sure the cursor points at an offset, indexing the next window
+     * of input if needed. Return false at the end of the input.
+     */
+    bool fill() {
+        if (cur < count)
+            return true;
+        cur = 0;
+        count = jsonindex_next(&stage1, index.get(), window);
+        if (count < 0) {
+            count = 0;
+            fail(JSON_ERROR_SYNTAX, __state.len - 1);
+        }
+        return count > 0;
+    }
+
+    /* peek(), offset(), take()
+     *
+     * The structural character and its offset at the cursor, and advancing
+     * past it; 0 and the end of the input once the index is exhausted.
+     */
+    char peek() {
+        return fill() ? __state.json[index[cur]] : 0;
+    }
+    jsonparse_offset_t offset() {
+        return fill() ? index[cur] : __state.len;
+    }
+    jsonparse_offset_t take() {
+        return fill() ? index[cur++] : __state.len;
+    }
+
+    /* scalar_end(start)
+     *
+     * Offset behind the number or literal starting at start.
+     */
+    jsonparse_offset_t scalar_end(jsonparse_offset_t start) const {
+        jsonparse_offset_t i = start;
+        while (i < __state.len) {
+            switch (__state.json[i]) {
+                case ' ': case '\t': case '\n': case '\r':
+                case '{': case '}': case '[': case ']': case ':': case ',': case '"':
+                    return i;
+            }
+            i++;
+        }
+        return i;
+    }
+
+    /* is_number_char(c)
+     *
+     * Whether c continues a number, by the same rule as atomic().
+     */
+    static bool is_number_char(char c) {
+        return (c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-';
+    }
+
+    /* follow(end)
+     *
+     * As with jsonparse_next(), a number or literal needs no separator
+     * before the next value: "[1true]" holds two. Stage 1 indexes only the
+     * start of such a run, so remember where the next value in it starts.
+     */
+    void follow(jsonparse_offset_t end) {
+        if (scalar_end(end) != end)
+            rest = end;
+    }
+
+    /* quoted_len(start)
+     *
+     * The length of the body of the string whose opening quote is at
+     * start; stage 1 guarantees the closing quote is the next offset.
+     */
+    jsonparse_offset_t quoted_len(jsonparse_offset_t start) {
+        const jsonparse_offset_t end = take();
+        return isFailed() ? 0 : end - start - 1;
+    }
+
+    Json parse_literal(jsonparse_offset_t start, const char *text, Json value) {
+        jsonparse_offset_t len = std::strlen(text);
+        if (__state.len - start < len || std::strncmp(__state.json + start, text, len) != 0)
+            return fail(JSON_ERROR_SYNTAX, start);
+        follow(start + len);
+        return value;
+    }
+
+    Json parse_value(int depth) {
+        if (depth > max_depth)
+            return fail(JSON_ERROR_MAXDEPTH, rest ? rest : offset());
+        jsonparse_offset_t start = rest;
+        if (start)
+            rest = 0;
+        else if (fill())
+            start = take();
+        else
+            return isFailed() ? Json() : fail(JSON_ERROR_SYNTAX, __state.len);
+
+        switch (__state.json[start]) {
+            case '{':
+                return parse_object(depth);
+            case '[':
+                return parse_array(depth);
+            case '"':
+                {
+                    const jsonparse_offset_t len = quoted_len(start);
+                    return isFailed() ? Json() : parse_string(start + 1, len);
+                }
+            case 't':
+                return parse_literal(start, "true", true);
+            case 'f':
+                return parse_literal(start, "false", false);
+            case 'n':
+                return parse_literal(start, "null", nullptr);
+            case '-': case '0': case '1': case '2': case '3': case '4':
+            case '5': case '6': case '7': case '8': case '9':
+                {
+                    jsonparse_offset_t end = start + 1;
+                    while (end < __state.len && is_number_char(__state.json[end]))
+                        end++;
+                    __state.vstart = start;
+                    __state.vlen = end - start;
+                    Json value = parse_number();
+                    if (isFailed())
+                        return fail(__state.error, start);
+                    follow(end);
+                    return value;
+                }
+            case ']':
+                return fail(JSON_ERROR_UNEXPECTED_END_OF_ARRAY, start);
+        }
+        return fail(JSON_ERROR_SYNTAX, start);
+    }
+
+    /* parse_object(depth), parse_array(depth)
+     *
+     * The separators are those jsonparse_next() accepts: an object may end
+     * in a comma, and commas in an array are optional and may repeat.
+     */
+    Json parse_object(int depth) {
+        const size_t first = members.size();
+        while (true) {
+            const char ch = peek();
+            if (ch == '}') {
+                cur++;
+                return make_object(first);
+            }
+            if (ch != '"')
+                return isFailed() ? Json() : fail(JSON_ERROR_UNEXPECTED_OBJECT, offset());
+            const jsonparse_offset_t start = take();
+            object_key key = parse_key(start + 1, quoted_len(start));
+            if (isFailed())
+                return Json();
+            if (peek() != ':')
+                return isFailed() ? Json() : fail(JSON_ERROR_UNEXPECTED_OBJECT, offset());
+            cur++;
+            Json value = parse_value(depth + 1);
+            if (isFailed())
+                return Json();
+            members.emplace_back(move(key), move(value));
+            if (rest)
+                return fail(JSON_ERROR_UNEXPECTED_OBJECT, rest);
+
+            const char next = peek();
+            const jsonparse_offset_t at = take();
+            if (next == '}')
+                return make_object(first);
+            if (next != ',')
+                return isFailed() ? Json() : fail(JSON_ERROR_UNEXPECTED_OBJECT, at);
+        }
+    }
+
+    Json parse_array(int depth) {
+        vector<Json> data;
+        while (true) {
+            if (!rest) {
+                const char ch = peek();
+                if (ch == ']') {
+                    cur++;
+                    return make_array(move(data));
+                }
+                if (ch == ',') {
+                    cur++;
+                    continue;
+                }
+            }
+            data.push_back(parse_value(depth + 1));
+            if (isFailed())
+                return Json();
+        }
+    }
+
+public:
+    JsonIndexParser(const ParseInput &in)
+        : JsonParser(in), index(new jsonparse_offset_t[window]), count(0), cur(0), rest(0) {
+        jsonindex_setup(&stage1, __state.json, __state.len);
+    }
+
+    /* parse_json()
+     *
+     * Build the tree while indexing the input (stage 1) ahead of it. Like
+     * jsonparse_next() this takes only an object or array at the top.
+     */
+    Json parse_json() {
+        const char ch = peek();
+        if (ch == '"')
+            return fail(JSON_ERROR_UNEXPECTED_STRING, offset());
+        if (ch != '{' && ch != '[')
+            return isFailed() ? Json() : fail(JSON_ERROR_SYNTAX, offset());
+        return parse_value(0);
+    }
+};
+
+/* JsonTapeParser
+ *
+ * Writes the tokens of jsonparse_next() to the tape of a JsonDocument
+ * instead of building a tree, see JsonDocument for the format.
+ */
+class JsonTapeParser : public JsonParser {
+    vector<uint64_t> &tape;
+    vector<char> &strings;
+
+    static uint64_t word(char tag, uint64_t payload) {
+        return JsonElement::word(tag, payload);
+    }
+
+public:
+    JsonTapeParser(const ParseInput &in, JsonDocument &doc)
+        : JsonParser(in), tape(doc.m_tape), strings(doc.m_strings) {
+        tape.clear();
+    }
+
+    void parse_json() {
+        if (isFailed())
+            return;
+        if (__state.depth > max_depth) {
+            __state.error = JSON_ERROR_MAXDEPTH;
+            return;
+        }
+        parse_token(jsonparse_next(&__state));
+    }
+
+    /* finish()
+     *
+     * Give back what the tape and the strings grew beyond their size.
+     */
+    void finish() {
+        tape.shrink_to_fit();
+        strings.shrink_to_fit();
+    }
+
+    void push_string(jsonparse_offset_t start, jsonparse_offset_t len) {
+        const char *body = __state.json + start;
+        const size_t offset = strings.size();
+        const bool is_long = (uint64_t)len >= JsonElement::long_string;
+        const size_t prefix = is_long ? sizeof(uint32_t) + sizeof(uint64_t) : sizeof(uint32_t);
+        strings.resize(offset + prefix + len);
+        char *out = strings.data() + offset + prefix;
+        if (std::memchr(body, '\\', len) == nullptr) {
+            std::memcpy(out, body, len);
+        } else {
+            len = jsonparse_unescape(body, len, out);
+            if (len < 0) {
+                __state.error = JSON_ERROR_SYNTAX;
+                __state.pos = start;
+                return;
+            }
+            strings.resize(offset + prefix + len);
+        }
+        if (is_long) {
+            const uint32_t mark = JsonElement::long_string;
+            const uint64_t size = len;
+            std::memcpy(&strings[offset], &mark, sizeof mark);
+            std::memcpy(&strings[offset + sizeof mark], &size, sizeof size);
+        } else {
+            const uint32_t size = len;
+            std::memcpy(&strings[offset], &size, sizeof size);
+        }
+        tape.push_back(word('"', offset));
+    }
+
+    /* push_number()
+     *
+     * The number token at vstart, kept like parse_number() keeps it.
+     * Integers that fit take one word.
+     */
+    void push_number() {
+        struct jsonnumber num;
+        if (jsonnumber_parse(__state.json + __state.vstart, __state.vlen, &num) != __state.vlen) {
+            __state.error = JSON_ERROR_SYNTAX;
+            return;
+        }
+        static const uint64_t small_max = (uint64_t)1 << (JsonElement::tag_shift - 1);
+        if (num.integer && !num.negative) {
+            if (num.mantissa < small_max) {
+                tape.push_back(word('i', num.mantissa));
+                return;
+            }
+            tape.push_back(word(num.mantissa <= (uint64_t)std::numeric_limits<int64_t>::max() ? 'l' : 'u', 0));
+            tape.push_back(num.mantissa);
+        } else if (num.integer && num.mantissa - 1 <= (uint64_t)std::numeric_limits<int64_t>::max()) {
+            if (num.mantissa <= small_max) {
+                tape.push_back(word('i', (0 - num.mantissa) & (((uint64_t)1 << JsonElement::tag_shift) - 1)));
+                return;
+            }
+            tape.push_back(word('l', 0));
+            tape.push_back(0 - num.mantissa);
+        } else {
+            uint64_t bits;
+            std::memcpy(&bits, &num.value, sizeof bits);
+            tape.push_back(word('d', 0));
+            tape.push_back(bits);
+        }
+    }
+
+    void parse_token(int n) {
+        switch (n) {
+            case JSON_TYPE_NUMBER:
+                push_number();
+                break;
+            case JSON_TYPE_TRUE:
+                tape.push_back(word('t', 0));
+                break;
+            case JSON_TYPE_FALSE:
+                tape.push_back(word('f', 0));
+                break;
+            case JSON_TYPE_NULL:
+                tape.push_back(word('n', 0));
+                break;
+            case JSON_TYPE_STRING:
+                push_string(__state.vstart, __state.vlen);
+                break;
+            case JSON_TYPE_OBJECT:
+                {
+                    const size_t open = tape.size();
+                    uint64_t count = 0;
+                    tape.push_back(0);
+                    while (true) {
+                        int ch = jsonparse_next(&__state);
+                        if (ch == JSON_TYPE_ERROR) {
+                            return;
+                        }
+                        if (ch == '}') {
+                            break;
+                        }
+                        if (ch == ',') {
+                            continue;
+                        }
+                        if (ch != JSON_TYPE_PAIR_NAME) {
+                            __state.error = JSON_ERROR_UNEXPECTED_OBJECT;
+                            return;
+                        }
+                        push_string(__state.vstart, __state.vlen);
+                        if (isFailed()) {
+                            return;
+                        }
+                        if (jsonparse_next(&__state) != ':') {
+                            __state.error = JSON_ERROR_UNEXPECTED_OBJECT;
+                            return;
+                        }
+                        parse_json();
+                        if (isFailed()) {
+                            return;
+                        }
+                        ++count;
+                    }
+                    tape.push_back(word('}', count));
+                    tape[open] = word('{', tape.size() - open);
+                }
+                break;
+            case JSON_TYPE_ARRAY:
+                {
+                    const size_t open = tape.size();
+                    uint64_t count = 0;
+                    tape.push_back(0);
+                    while (true) {
+                        int ch = jsonparse_next(&__state);
+                        if (ch == JSON_TYPE_ERROR) {
+                            return;
+                        }
+                        if (ch == ']') {
+                            break;
+                        }
+                        if (ch == ',') {
+                            continue;
+                        }
+                        parse_token(ch);
+                        if (isFailed()) {
+                            return;
+                        }
+                        ++count;
+                    }
+                    tape.push_back(word(']', count));
+                    tape[open] = word('[', tape.size() - open);
+                }
+                break;
+            default:
+                tape.push_back(word('n', 0));
+                break;
+        }
+    }
+};
+
+template <class Parser>
+static Json parse_with(const ParseInput &in, string &err) {
+    Parser parser(in);
     Json result = parser.parse_json();
     if (parser.isFailed()) {
         parser.failMsg(err);
@@ -550,12 +2094,189 @@ Json Json::parse(const string &in, string &err) {
     return result;
 }
 
+static Json parse_input(const ParseInput &in, string &err, int options) {
+    if (in.len > (size_t)JSONPARSE_MAX_LEN) {
+        err = "document too large, build with JSONPARSE_CONF_LARGE_DOCUMENTS";
+        return Json();
+    }
+    if (options & Json::PARSE_STRUCTURAL_INDEX) {
+        return parse_with<JsonIndexParser>(in, err);
+    }
+    return parse_with<JsonParser>(in, err);
+}
+
+Json Json::parse(const string &in, string &err, int options) {
+    return parse_input({ in.data(), in.size(), nullptr, nullptr, (options & PARSE_ARENA) != 0,
+                         (options & PARSE_INTERN_KEYS) != 0 },
+                       err, options);
+}
+
+Json Json::parse(const char *in, string &err, int options) {
+    if (!in) {
+        err = "null input";
+        return nullptr;
+    }
+    return parse_input({ in, std::strlen(in), nullptr, nullptr, (options & PARSE_ARENA) != 0,
+                         (options & PARSE_INTERN_KEYS) != 0 },
+                       err, options);
+}
+
+Json Json::parse(string &&in, string &err, int options) {
+    std::shared_ptr<string> text = std::make_shared<string>(move(in));
+    char *buffer = &(*text)[0];
+    const size_t len = text->size();
+    return parse_input({ buffer, len, buffer, move(text), (options & PARSE_ARENA) != 0,
+                         (options & PARSE_INTERN_KEYS) != 0 },
+                       err, options);
+}
+
+Json Json::parse(std::unique_ptr<char[]> buffer, size_t len, string &err, int options) {
+    if (!buffer) {
+        err = "null input";
+        return nullptr;
+    }
+    char *data = buffer.get();
+    std::shared_ptr<const void> owner(buffer.release(), std::default_delete<char[]>());
+    return parse_input({ data, len, data, move(owner), (options & PARSE_ARENA) != 0,
+                         (options & PARSE_INTERN_KEYS) != 0 },
+                       err, options);
+}
+
+Json Json::parse_insitu(char *buffer, string &err, int options) {
+    if (!buffer) {
+        err = "null input";
+        return nullptr;
+    }
+    return parse_input({ buffer, std::strlen(buffer), buffer, nullptr, (options & PARSE_ARENA) != 0,
+                         (options & PARSE_INTERN_KEYS) != 0 },
+                       err, options);
+}
+
+Json Json::parse_borrowed(std::shared_ptr<const string> in, string &err, int options) {
+    if (!in) {
+        err = "null input";
+        return nullptr;
+    }
+    const char *data = in->data();
+    const size_t len = in->size();
+    return parse_input({ data, len, nullptr, move(in), (options & PARSE_ARENA) != 0,
+                         (options & PARSE_INTERN_KEYS) != 0 },
+                       err, options);
+}
+
 vector<Json> Json::parse_multi(const string &in, string &err) {
-    JsonParser parser { in };
+    JsonParser parser({ in.data(), in.size(), nullptr, nullptr, false, false });
     vector<Json> json_vec;
     return json_vec;
 }
 
+JsonDocument JsonDocument::parse(const string &in, string &err) {
+    JsonDocument doc;
+    if (in.size() > (size_t)JSONPARSE_MAX_LEN) {
+        err = "document too large, build with JSONPARSE_CONF_LARGE_DOCUMENTS";
+        return doc;
+    }
+    JsonTapeParser parser({ in.data(), in.size(), nullptr, nullptr, false, false }, doc);
+    parser.parse_json();
+    if (parser.isFailed()) {
+        parser.failMsg(err);
+        return JsonDocument();
+    }
+    parser.finish();
+    return doc;
+}
+
+/* * * * * * * * * * * * * * * * * * * *
+ * Tape elements
+ */
+
+static const uint64_t tape_null = (uint64_t)'n' << 56;
+
+int64_t JsonElement::int64_value() const {
+    switch (tag(m_word)) {
+        case 'i': return small_int(m_word);
+        case 'l': case 'u': return (int64_t)m_word[1];
+        case 'd': return (int64_t)number_value();
+        default:  return 0;
+    }
+}
+
+uint64_t JsonElement::uint64_value() const {
+    switch (tag(m_word)) {
+        case 'i': return (uint64_t)small_int(m_word);
+        case 'l': case 'u': return m_word[1];
+        case 'd': return (uint64_t)number_value();
+        default:  return 0;
+    }
+}
+
+size_t JsonElement::size() const {
+    const char t = tag(m_word);
+    if (t != '[' && t != '{')
+        return 0;
+    return payload(m_word + payload(m_word) - 1);
+}
+
+JsonElement JsonElement::operator[] (size_t i) const {
+    if (tag(m_word) == '[') {
+        for (const uint64_t *item = m_word + 1; tag(item) != ']'; item = next(item))
+            if (i-- == 0)
+                return JsonElement(item, m_strings);
+    }
+    return JsonElement(&tape_null, nullptr);
+}
+
+JsonElement JsonElement::operator[] (string_view key) const {
+    const uint64_t *found = &tape_null;
+    if (tag(m_word) == '{') {
+        for (const uint64_t *member = m_word + 1; tag(member) != '}'; member = next(member + 1))
+            if (string_at(member, m_strings) == key)
+                found = member + 1;
+    }
+    return JsonElement(found, m_strings);
+}
+
+JsonElement::iterator JsonElement::begin() const {
+    const char t = tag(m_word);
+    if (t != '[' && t != '{')
+        return end();
+    return iterator(m_word + 1, m_strings, t == '{');
+}
+
+JsonElement::iterator JsonElement::end() const {
+    const char t = tag(m_word);
+    if (t != '[' && t != '{')
+        return iterator(m_word, m_strings, false);
+    return iterator(m_word + payload(m_word) - 1, m_strings, t == '{');
+}
+
+Json JsonElement::to_json() const {
+    switch (tag(m_word)) {
+        case 't': return true;
+        case 'f': return false;
+        case 'i': return Json(small_int(m_word));
+        case 'l': return Json((int64_t)m_word[1]);
+        case 'u': return Json(m_word[1]);
+        case 'd': return Json(number_value());
+        case '"': return Json(string_view_value().to_string());
+        case '[': {
+            Json::array items;
+            items.reserve(size());
+            for (const JsonElement &item : *this)
+                items.push_back(item.to_json());
+            return Json(move(items));
+        }
+        case '{': {
+            vector<Json::object::value_type> members;
+            members.reserve(size());
+            for (iterator it = begin(); it != end(); ++it)
+                members.emplace_back(object_key(it.key()), (*it).to_json());
+            return Json(Json::object(move(members)));
+        }
+        default:  return nullptr;
+    }
+}
+
 /* * * * * * * * * * * * * * * * * * * *
  * Shape-checking
  */
@@ -0,0 +1,234 @@
+#include <c/jsonindex.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "./jsonsimd.h"
+
+/* bitmaps of one 64 byte block of input, bit i stands for byte i */
+struct block {
+    uint64_t quote;
+    uint64_t bslash;
+    uint64_t ws;
+    uint64_t op;
+};
+/*--------------------------------------------------------------------*/
+static int ctz64(uint64_t x) {
+#ifdef __GNUC__
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while((x & 1) == 0) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+/*--------------------------------------------------------------------*/
+static void classify_scalar(const char *in, struct block *b) {
+    uint64_t bit;
+    int i;
+
+    memset(b, 0, sizeof(*b));
+    for (i = 0; i < 64; i++) {
+        bit = (uint64_t)1 << i;
+        switch(in[i]) {
+            case '"':
+                b->quote |= bit;
+                break;
+            case '\\':
+                b->bslash |= bit;
+                break;
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\r':
+                b->ws |= bit;
+                break;
+            case '{':
+            case '}':
+            case '[':
+            case ']':
+            case ':':
+            case ',':
+                b->op |= bit;
+                break;
+        }
+    }
+}
+/*--------------------------------------------------------------------*/
+#ifdef JSONPARSE_SIMD_X86
+/* '[' and ']' differ from '{' and '}' only in bit 5, so brackets and braces
+   are found with two compares on the input or'ed with 0x20 */
+/*--------------------------------------------------------------------*/
+__attribute__((target("sse2")))
+static void classify_sse2(const char *in, struct block *b) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i bslash = _mm_set1_epi8('\\');
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i bit5 = _mm_set1_epi8(0x20);
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    __m128i v, folded, ws, op;
+    int i, shift;
+
+    memset(b, 0, sizeof(*b));
+    for (i = 0; i < 4; i++) {
+        shift = 16 * i;
+        v = _mm_loadu_si128((const __m128i *)(in + shift));
+        folded = _mm_or_si128(v, bit5);
+        ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)),
+                          _mm_or_si128(_mm_cmpeq_epi8(v, nl), _mm_cmpeq_epi8(v, cr)));
+        op = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)),
+                          _mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, comma)));
+        b->quote |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << shift;
+        b->bslash |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v, bslash)) << shift;
+        b->ws |= (uint64_t)(unsigned int)_mm_movemask_epi8(ws) << shift;
+        b->op |= (uint64_t)(unsigned int)_mm_movemask_epi8(op) << shift;
+    }
+}
+/*--------------------------------------------------------------------*/
+__attribute__((target("avx2")))
+static void classify_avx2(const char *in, struct block *b) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i bslash = _mm256_set1_epi8('\\');
+    const __m256i sp = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i bit5 = _mm256_set1_epi8(0x20);
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i comma = _mm256_set1_epi8(',');
+    __m256i v, folded, ws, op;
+    int i, shift;
+
+    memset(b, 0, sizeof(*b));
+    for (i = 0; i < 2; i++) {
+        shift = 32 * i;
+        v = _mm256_loadu_si256((const __m256i *)(in + shift));
+        folded = _mm256_or_si256(v, bit5);
+        ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tab)),
+                             _mm256_or_si256(_mm256_cmpeq_epi8(v, nl), _mm256_cmpeq_epi8(v, cr)));
+        op = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(folded, open), _mm256_cmpeq_epi8(folded, close)),
+                             _mm256_or_si256(_mm256_cmpeq_epi8(v, colon), _mm256_cmpeq_epi8(v, comma)));
+        b->quote |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)) << shift;
+        b->bslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, bslash)) << shift;
+        b->ws |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ws) << shift;
+        b->op |= (uint64_t)(uint32_t)_mm256_movemask_epi8(op) << shift;
+    }
+}
+#endif
+/*--------------------------------------------------------------------*/
+/* characters escaped by a backslash: every second one of a backslash run,
+   counted from its start, plus the character after an odd run.
+   *prev_escaped carries an escape over into the next block */
+/*--------------------------------------------------------------------*/
+static uint64_t find_escaped(uint64_t bslash, uint64_t *prev_escaped) {
+    const uint64_t even_bits = 0x5555555555555555ULL;
+    uint64_t follows_escape;
+    uint64_t odd_starts;
+    uint64_t even_runs;
+
+    bslash &= ~*prev_escaped;
+    follows_escape = bslash << 1 | *prev_escaped;
+    /* adding the starts of the runs beginning on an odd bit flips the
+       parity of those runs, the carry leaves every run at its end */
+    odd_starts = bslash & ~even_bits & ~follows_escape;
+    even_runs = odd_starts + bslash;
+    *prev_escaped = even_runs < bslash;
+    return (even_bits ^ (even_runs << 1)) & follows_escape;
+}
+/*--------------------------------------------------------------------*/
+/* bit i of the result is the parity of the bits 0..i of x */
+/*--------------------------------------------------------------------*/
+static uint64_t prefix_xor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+/*--------------------------------------------------------------------*/
+void jsonindex_setup(struct jsonindex_state *state, const char *json, jsonparse_offset_t len) {
+    state->json = json;
+    state->len = len;
+    state->pos = 0;
+    state->prev_escaped = 0;
+    state->prev_in_string = 0;
+    state->prev_scalar = 0;
+}
+/*--------------------------------------------------------------------*/
+jsonparse_offset_t jsonindex_next(struct jsonindex_state *state, jsonparse_offset_t *index,
+                                  jsonparse_offset_t size) {
+    void (*classify)(const char *, struct block *) = classify_scalar;
+    uint64_t quote, in_string, scalar, bits;
+    struct block b;
+    char tail[64];
+    const char *in;
+    jsonparse_offset_t n = 0;
+
+#ifdef JSONPARSE_SIMD_X86
+    switch (simd_level()) {
+        case SIMD_AVX2:
+            classify = classify_avx2;
+            break;
+        case SIMD_SSE2:
+            classify = classify_sse2;
+            break;
+    }
+#endif
+    /* a block yields at most 64 offsets */
+    for (; state->pos < state->len && n + 64 <= size; state->pos += 64) {
+        in = state->json + state->pos;
+        if (state->len - state->pos < 64) {
+            /* pad the last block with blanks, they never show up */
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, in, state->len - state->pos);
+            in = tail;
+        }
+        classify(in, &b);
+
+        quote = b.quote & ~find_escaped(b.bslash, &state->prev_escaped);
+        /* opening quote and string body, without the closing quote */
+        in_string = prefix_xor(quote) ^ state->prev_in_string;
+        state->prev_in_string = (uint64_t)((int64_t)in_string >> 63);
+
+        scalar = ~(b.op | b.ws | quote | in_string);
+        bits = (b.op & ~in_string) | quote | (scalar & ~(scalar << 1 | state->prev_scalar));
+        state->prev_scalar = scalar >> 63;
+
+        while(bits != 0) {
+            index[n++] = state->pos + ctz64(bits);
+            bits &= bits - 1;
+        }
+    }
+    if (n == 0 && state->prev_in_string) {
+        return -1;
+    }
+    return n;
+}
+/*--------------------------------------------------------------------*/
+jsonparse_offset_t jsonindex_build(const char *json, jsonparse_offset_t len,
+                                   jsonparse_offset_t *index) {
+    struct jsonindex_state state;
+    jsonparse_offset_t n = 0;
+    jsonparse_offset_t count;
+
+    jsonindex_setup(&state, json, len);
+    /* len entries always hold all offsets, but the last window may be
+       smaller than a block */
+    while((count = jsonindex_next(&state, index + n, len - n < 64 ? 64 : len - n)) > 0) {
+        n += count;
+    }
+    return count < 0 ? -1 : n;
+}
+/*--------------------------------------------------------------------*/
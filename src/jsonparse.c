@@ -1,7 +1,10 @@
 #include <c/jsonparse.h>
+#include <c/jsonnumber.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "./jsonsimd.h"
+
 /*--------------------------------------------------------------------*/
 static void clear_value(struct jsonparse_state*state){
     state->vtype = 0;
@@ -10,10 +13,13 @@ static void clear_value(struct jsonparse_state*state){
 }
 /*--------------------------------------------------------------------*/
 static int push(struct jsonparse_state *state, char c) {
+    if (state->depth >= JSONPARSE_MAX_DEPTH) {
+        return 0;
+    }
     state->stack[state->depth] = c;
     state->depth++;
     clear_value(state);
-    return state->depth < JSONPARSE_MAX_DEPTH;
+    return 1;
 }
 /*--------------------------------------------------------------------*/
 static char pop(struct jsonparse_state *state) {
@@ -24,30 +30,113 @@ static char pop(struct jsonparse_state *state) {
     return state->stack[state->depth];
 }
 /*--------------------------------------------------------------------*/
+#ifdef JSONPARSE_SIMD_X86
+/* find the next byte of a string body that needs a closer look: the closing
+   quote, a backslash or the terminating zero; blocks are only loaded while
+   they lie entirely inside the buffer, the position where scanning stopped
+   is returned when none is found */
+/*--------------------------------------------------------------------*/
+__attribute__((target("sse2")))
+static jsonparse_offset_t scan_string_sse2(const char *json, jsonparse_offset_t pos,
+        jsonparse_offset_t len) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i bslash = _mm_set1_epi8('\\');
+    const __m128i zero = _mm_setzero_si128();
+    __m128i v, hit;
+    unsigned int mask;
+
+    while(pos + 16 <= len) {
+        v = _mm_loadu_si128((const __m128i *)(json + pos));
+        hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, bslash)),
+                           _mm_cmpeq_epi8(v, zero));
+        mask = (unsigned int)_mm_movemask_epi8(hit);
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 16;
+    }
+    return pos;
+}
+/*--------------------------------------------------------------------*/
+__attribute__((target("avx2")))
+static jsonparse_offset_t scan_string_avx2(const char *json, jsonparse_offset_t pos,
+        jsonparse_offset_t len) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i bslash = _mm256_set1_epi8('\\');
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i v, hit;
+    unsigned int mask;
+
+    while(pos + 32 <= len) {
+        v = _mm256_loadu_si256((const __m256i *)(json + pos));
+        hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, bslash)),
+                              _mm256_cmpeq_epi8(v, zero));
+        mask = (unsigned int)_mm256_movemask_epi8(hit);
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 32;
+    }
+    return pos;
+}
+/*--------------------------------------------------------------------*/
+static jsonparse_offset_t scan_string(const char *json, jsonparse_offset_t pos,
+        jsonparse_offset_t len) {
+    switch (simd_level()) {
+        case SIMD_AVX2:
+            return scan_string_avx2(json, pos, len);
+        case SIMD_SSE2:
+            return scan_string_sse2(json, pos, len);
+    }
+    return pos;
+}
+#endif
+/*--------------------------------------------------------------------*/
 /* will pass by the value and store the start and length of the value for
    atomic types */
 /*--------------------------------------------------------------------*/
 static void atomic(struct jsonparse_state *state, char type) {
     char c;
+    int n;
 
     state->vstart = state->pos;
     state->vtype = type;
     if (type == JSON_TYPE_STRING || type == JSON_TYPE_PAIR_NAME) {
-        while((c = state->json[state->pos++]) && c != '"') {
-            if (c == '\\') {
-                state->pos++;           /* skip current char */
+        do {
+            /* keys and short values end within a few bytes, a call into the
+               vector kernel only pays off for longer runs of plain bytes */
+            for (n = 0; n < 16 && state->pos < state->len; n++) {
+                c = state->json[state->pos];
+                if (c == '"' || c == '\\' || c == 0) {
+                    break;
+                }
+                state->pos++;
             }
-        }
+#ifdef JSONPARSE_SIMD_X86
+            if (n == 16) {
+                state->pos = scan_string(state->json, state->pos, state->len);
+            }
+#endif
+            if (state->pos >= state->len) {
+                /* the text ends inside the string, the next token fails */
+                state->vlen = state->len - state->vstart;
+                return;
+            }
+            c = state->json[state->pos++];
+            if (c == '\\' && state->pos < state->len) {
+                state->pos++;           /* skip escaped char */
+            }
+        } while(c && c != '"');
         state->vlen = state->pos - state->vstart - 1;
     } else if (type == JSON_TYPE_NUMBER) {
-        do {
+        while(state->pos < state->len) {
             c = state->json[state->pos];
-            if ((c < '0' || c > '9') && c != '.') {
-                c = 0;
-            } else {
-                state->pos++;
+            if ((c < '0' || c > '9') && c != '.' && c != 'e' && c != 'E'
+                    && c != '+' && c != '-') {
+                break;
             }
-        } while(c);
+            state->pos++;
+        }
         /* need to back one step since first char is already gone */
         state->vstart--;
         state->vlen = state->pos - state->vstart;
@@ -67,16 +156,83 @@ static void atomic(struct jsonparse_state *state, char type) {
     /* no other types for now... */
 }
 /*--------------------------------------------------------------------*/
-static void skip_ws(struct jsonparse_state *state) {
-    char c;
+#define IS_WS(c) ((c) == ' ' || (c) == '\n' || (c) == '\r' || (c) == '\t')
+/*--------------------------------------------------------------------*/
+#ifdef JSONPARSE_SIMD_X86
+/* skip whole blocks of whitespace, stopping before the first block that
+   would reach past the end of the buffer; return the new position */
+/*--------------------------------------------------------------------*/
+__attribute__((target("sse2")))
+static jsonparse_offset_t skip_ws_sse2(const char *json, jsonparse_offset_t pos,
+        jsonparse_offset_t len) {
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i nl = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i tab = _mm_set1_epi8('\t');
+    __m128i v, ws;
+    unsigned int mask;
 
-    while(state->pos < state->len &&
-            ((c = state->json[state->pos]) == ' ' || c == '\n' || c == '\r' || c == '\t')) {
+    while(pos + 16 <= len) {
+        v = _mm_loadu_si128((const __m128i *)(json + pos));
+        ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, nl)),
+                          _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, tab)));
+        mask = (unsigned int)_mm_movemask_epi8(ws) ^ 0xffffu;
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 16;
+    }
+    return pos;
+}
+/*--------------------------------------------------------------------*/
+__attribute__((target("avx2")))
+static jsonparse_offset_t skip_ws_avx2(const char *json, jsonparse_offset_t pos,
+        jsonparse_offset_t len) {
+    const __m256i sp = _mm256_set1_epi8(' ');
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    __m256i v, ws;
+    unsigned int mask;
+
+    while(pos + 32 <= len) {
+        v = _mm256_loadu_si256((const __m256i *)(json + pos));
+        ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, nl)),
+                             _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, tab)));
+        mask = ~(unsigned int)_mm256_movemask_epi8(ws);
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+        pos += 32;
+    }
+    return pos;
+}
+#endif
+/*--------------------------------------------------------------------*/
+static void skip_ws(struct jsonparse_state *state) {
+    /* tokens are mostly separated by a single blank or none at all, only
+       longer runs (indentation) are worth a trip through the vector unit */
+    if (state->pos < state->len && !IS_WS(state->json[state->pos])) {
+        return;
+    }
+#ifdef JSONPARSE_SIMD_X86
+    if (state->pos + 1 < state->len && IS_WS(state->json[state->pos + 1])) {
+        switch (simd_level()) {
+            case SIMD_AVX2:
+                state->pos = skip_ws_avx2(state->json, state->pos, state->len);
+                break;
+            case SIMD_SSE2:
+                state->pos = skip_ws_sse2(state->json, state->pos, state->len);
+                break;
+        }
+    }
+#endif
+    while(state->pos < state->len && IS_WS(state->json[state->pos])) {
         state->pos++;
     }
 }
 /*--------------------------------------------------------------------*/
-void jsonparse_setup(struct jsonparse_state *state, const char *json, int len) {
+void jsonparse_setup(struct jsonparse_state *state, const char *json, jsonparse_offset_t len) {
     state->json = json;
     state->len = len;
     state->pos = 0;
@@ -88,114 +244,119 @@ void jsonparse_setup(struct jsonparse_state *state, const char *json, int len) {
     state->stack[0] = 0;
 }
 /*--------------------------------------------------------------------*/
+/* jsonparse_next() dispatches through two tables instead of branching on
+   every character: the class of the character and the container the
+   tokenizer is in select the action to take */
+/*--------------------------------------------------------------------*/
+enum {
+    C_ERROR, C_OBJECT, C_OBJECT_END, C_ARRAY, C_ARRAY_END, C_PAIR, C_COMMA,
+    C_STRING, C_NULL, C_TRUE, C_FALSE, C_NUMBER, C_COUNT
+};
+/* X_PAIR_VALUE is a pair whose value has been read */
+enum {
+    X_NONE, X_OBJECT, X_ARRAY, X_PAIR, X_PAIR_VALUE, X_COUNT
+};
+enum {
+    A_SYNTAX_ERROR, A_END_OF_ARRAY_ERROR, A_STRING_ERROR, A_PUSH, A_POP,
+    A_POP_PAIR, A_COMMA, A_COMMA_PAIR, A_PAIR_NAME, A_STRING, A_LITERAL, A_NUMBER
+};
+
+static const unsigned char char_class[256] = {
+    ['{'] = C_OBJECT, ['}'] = C_OBJECT_END, ['['] = C_ARRAY, [']'] = C_ARRAY_END,
+    [':'] = C_PAIR, [','] = C_COMMA, ['"'] = C_STRING,
+    ['n'] = C_NULL, ['t'] = C_TRUE, ['f'] = C_FALSE,
+    ['-'] = C_NUMBER, ['0'] = C_NUMBER, ['1'] = C_NUMBER, ['2'] = C_NUMBER,
+    ['3'] = C_NUMBER, ['4'] = C_NUMBER, ['5'] = C_NUMBER, ['6'] = C_NUMBER,
+    ['7'] = C_NUMBER, ['8'] = C_NUMBER, ['9'] = C_NUMBER
+};
+
+static const unsigned char container[256] = {
+    ['{'] = X_OBJECT, ['['] = X_ARRAY, [':'] = X_PAIR
+};
+
+static const unsigned char transition[C_COUNT][X_COUNT] = {
+    /*                 X_NONE                X_OBJECT              X_ARRAY               X_PAIR                X_PAIR_VALUE */
+    [C_ERROR]      = { A_SYNTAX_ERROR,       A_SYNTAX_ERROR,       A_SYNTAX_ERROR,       A_SYNTAX_ERROR,       A_SYNTAX_ERROR },
+    [C_OBJECT]     = { A_PUSH,               A_PUSH,               A_PUSH,               A_PUSH,               A_PUSH },
+    [C_OBJECT_END] = { A_SYNTAX_ERROR,       A_POP,                A_SYNTAX_ERROR,       A_SYNTAX_ERROR,       A_POP_PAIR },
+    [C_ARRAY]      = { A_PUSH,               A_PUSH,               A_PUSH,               A_PUSH,               A_PUSH },
+    [C_ARRAY_END]  = { A_END_OF_ARRAY_ERROR, A_END_OF_ARRAY_ERROR, A_POP,                A_END_OF_ARRAY_ERROR, A_END_OF_ARRAY_ERROR },
+    [C_PAIR]       = { A_PUSH,               A_PUSH,               A_PUSH,               A_PUSH,               A_PUSH },
+    [C_COMMA]      = { A_SYNTAX_ERROR,       A_SYNTAX_ERROR,       A_COMMA,              A_SYNTAX_ERROR,       A_COMMA_PAIR },
+    [C_STRING]     = { A_STRING_ERROR,       A_PAIR_NAME,          A_STRING,             A_STRING,             A_STRING },
+    [C_NULL]       = { A_SYNTAX_ERROR,       A_SYNTAX_ERROR,       A_LITERAL,            A_LITERAL,            A_LITERAL },
+    [C_TRUE]       = { A_SYNTAX_ERROR,       A_SYNTAX_ERROR,       A_LITERAL,            A_LITERAL,            A_LITERAL },
+    [C_FALSE]      = { A_SYNTAX_ERROR,       A_SYNTAX_ERROR,       A_LITERAL,            A_LITERAL,            A_LITERAL },
+    [C_NUMBER]     = { A_SYNTAX_ERROR,       A_SYNTAX_ERROR,       A_NUMBER,             A_NUMBER,             A_NUMBER },
+};
+
+/* null, true and false; their type is their first character */
+static const char *const literal[3] = { "null", "true", "false" };
+static const int literal_len[3] = { 4, 4, 5 };
+/*--------------------------------------------------------------------*/
 int jsonparse_next(struct jsonparse_state *state) {
     char c;
-    char s;
+    int x;
 
     skip_ws(state);
     c = state->json[state->pos];
-    s = jsonparse_get_type(state);
+    x = container[(unsigned char)jsonparse_get_type(state)];
+    x += x == X_PAIR && state->vtype != 0;
     state->pos++;
 
-    switch(c) {
-        case '{':
-            push(state, c);
-            return c;
-        case '}':
-            if (s == ':' && state->vtype != 0) {
-                /*       printf("Popping vtype: '%c'\n", state->vtype); */
-                pop(state);
-                s = jsonparse_get_type(state);
-            }
-            if (s == '{') {
-                pop(state);
-            } else {
-                state->error = JSON_ERROR_SYNTAX;
-                return JSON_TYPE_ERROR;
-            }
-            return c;
-        case ']':
-            if (s == '[') {
-                pop(state);
-            } else {
-                state->error = JSON_ERROR_UNEXPECTED_END_OF_ARRAY;
+    switch(transition[char_class[(unsigned char)c]][x]) {
+        case A_PUSH:
+            if (!push(state, c)) {
+                state->error = JSON_ERROR_MAXDEPTH;
                 return JSON_TYPE_ERROR;
             }
             return c;
-        case ':':
-            push(state, c);
-            return c;
-        case ',':
-            /* if x:y ... , */
-            if (s == ':' && state->vtype != 0) {
-                pop(state);
-            } else if (s == '[') {
-                /* ok! */
-            } else {
+        case A_POP_PAIR:
+            pop(state);
+            if (jsonparse_get_type(state) != '{') {
                 state->error = JSON_ERROR_SYNTAX;
                 return JSON_TYPE_ERROR;
             }
+            /* fall through */
+        case A_POP:
+            pop(state);
+            /* a closed container is a value of the enclosing pair */
+            clear_value(state);
+            state->vtype = c;
             return c;
-        case '"':
-            if (s == '{' || s == '[' || s == ':') {
-                atomic(state, c = (s == '{' ? JSON_TYPE_PAIR_NAME : c));
-            } else {
-                state->error = JSON_ERROR_UNEXPECTED_STRING;
-                return JSON_TYPE_ERROR;
-            }
+        case A_COMMA_PAIR:
+            /* if x:y ... , */
+            pop(state);
             return c;
-        case '[':
-            push(state, c);
+        case A_COMMA:
             return c;
-        case 'n':
-            if ((s == ':' || s == '[') && strncmp("null", state->json + state->pos - 1, 4) == 0) {
-                atomic(state, JSON_TYPE_NULL);
-                return JSON_TYPE_NULL;
-            }else{
-                state->error = JSON_ERROR_SYNTAX;
-                return JSON_TYPE_ERROR;
-            }
-            break;
-        case 't':
-            if ((s == ':' || s == '[') && strncmp("true", state->json + state->pos - 1, 4) == 0) {
-                atomic(state, JSON_TYPE_TRUE);
-                return JSON_TYPE_TRUE;
-            }else{
+        case A_PAIR_NAME:
+            atomic(state, JSON_TYPE_PAIR_NAME);
+            return JSON_TYPE_PAIR_NAME;
+        case A_STRING:
+            atomic(state, JSON_TYPE_STRING);
+            return JSON_TYPE_STRING;
+        case A_LITERAL:
+            x = char_class[(unsigned char)c] - C_NULL;
+            if (strncmp(literal[x], state->json + state->pos - 1, literal_len[x]) != 0) {
                 state->error = JSON_ERROR_SYNTAX;
                 return JSON_TYPE_ERROR;
             }
-            break;
-        case 'f':
-            if ((s == ':' || s == '[') && strncmp("false", state->json + state->pos - 1, 5) == 0) {
-                atomic(state, JSON_TYPE_FALSE);
-                return JSON_TYPE_FALSE;
-            }else {
-                state->error = JSON_ERROR_SYNTAX;
-                return JSON_TYPE_ERROR;
-            }
-            break;
-        case '-':
-        case '0':
-        case '1':
-        case '2':
-        case '3':
-        case '4':
-        case '5':
-        case '6':
-        case '7':
-        case '8':
-        case '9':
-            if (s == ':' || s == '[') {
-                atomic(state, JSON_TYPE_NUMBER);
-                return JSON_TYPE_NUMBER;
-            }
-            state->error = JSON_ERROR_SYNTAX;
+            atomic(state, c);
+            return c;
+        case A_NUMBER:
+            atomic(state, JSON_TYPE_NUMBER);
+            return JSON_TYPE_NUMBER;
+        case A_END_OF_ARRAY_ERROR:
+            state->error = JSON_ERROR_UNEXPECTED_END_OF_ARRAY;
+            return JSON_TYPE_ERROR;
+        case A_STRING_ERROR:
+            state->error = JSON_ERROR_UNEXPECTED_STRING;
             return JSON_TYPE_ERROR;
         default:
             state->error = JSON_ERROR_SYNTAX;
             return JSON_TYPE_ERROR;
     }
-    return 0;
 }
 /*--------------------------------------------------------------------*/
 /* get the json value of the current position
@@ -208,7 +369,7 @@ int jsonparse_copy_value(struct jsonparse_state *state, char *str, int size) {
     if (state->vtype == 0) {
         return 0;
     }
-    size = size <= state->vlen ? (size - 1) : state->vlen;
+    size = size <= state->vlen ? (size - 1) : (int)state->vlen;
     for (i = 0; i < size; i++) {
         str[i] = state->json[state->vstart + i];
     }
@@ -230,6 +391,115 @@ long jsonparse_get_value_as_long(struct jsonparse_state *state) {
     return atol(&state->json[state->vstart]);
 }
 /*--------------------------------------------------------------------*/
+double jsonparse_get_value_as_double(struct jsonparse_state *state) {
+    struct jsonnumber num;
+
+    if (state->vtype != JSON_TYPE_NUMBER
+            || jsonnumber_parse(&state->json[state->vstart], state->vlen, &num) != state->vlen) {
+        return 0;
+    }
+    return num.value;
+}
+/*--------------------------------------------------------------------*/
+static int hex4(const char *p) {
+    int i, v = 0;
+    char c;
+
+    for (i = 0; i < 4; i++) {
+        c = p[i];
+        if (c >= '0' && c <= '9') {
+            v = (v << 4) | (c - '0');
+        } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+            v = (v << 4) | ((c | 0x20) - 'a' + 10);
+        } else {
+            return -1;
+        }
+    }
+    return v;
+}
+/*--------------------------------------------------------------------*/
+/* write code point cp as UTF-8, return the number of bytes */
+static int encode_utf8(long cp, char *out) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    } else if (cp < 0x800) {
+        out[0] = (char)((cp >> 6) | 0xC0);
+        out[1] = (char)((cp & 0x3F) | 0x80);
+        return 2;
+    } else if (cp < 0x10000) {
+        out[0] = (char)((cp >> 12) | 0xE0);
+        out[1] = (char)(((cp >> 6) & 0x3F) | 0x80);
+        out[2] = (char)((cp & 0x3F) | 0x80);
+        return 3;
+    }
+    out[0] = (char)((cp >> 18) | 0xF0);
+    out[1] = (char)(((cp >> 12) & 0x3F) | 0x80);
+    out[2] = (char)(((cp >> 6) & 0x3F) | 0x80);
+    out[3] = (char)((cp & 0x3F) | 0x80);
+    return 4;
+}
+/*--------------------------------------------------------------------*/
+jsonparse_offset_t jsonparse_unescape(const char *str, jsonparse_offset_t len, char *out) {
+    const char *end = str + len;
+    const char *p = (const char *)memchr(str, '\\', len);
+    const char *run;
+    char *o;
+    long cp, lo;
+
+    if (p == NULL) {
+        if (out != str) {
+            memmove(out, str, len);
+        }
+        return len;
+    }
+    memmove(out, str, p - str);
+    o = out + (p - str);
+    /* every escape is at least as long as what it decodes to, so o never
+       overtakes p and out may be str itself */
+    while (p < end) {
+        if (*p != '\\') {
+            run = (const char *)memchr(p, '\\', end - p);
+            run = run ? run : end;
+            memmove(o, p, run - p);
+            o += run - p;
+            p = run;
+            continue;
+        }
+        if (end - p < 2) {
+            return -1;
+        }
+        p += 2;
+        switch (p[-1]) {
+            case '"':  *o++ = '"';  break;
+            case '\\': *o++ = '\\'; break;
+            case '/':  *o++ = '/';  break;
+            case 'b':  *o++ = '\b'; break;
+            case 'f':  *o++ = '\f'; break;
+            case 'n':  *o++ = '\n'; break;
+            case 'r':  *o++ = '\r'; break;
+            case 't':  *o++ = '\t'; break;
+            case 'u':
+                if (end - p < 4 || (cp = hex4(p)) < 0) {
+                    return -1;
+                }
+                p += 4;
+                /* a high surrogate followed by a low one is one code point,
+                   an unpaired surrogate is kept as it is */
+                if (cp >= 0xD800 && cp <= 0xDBFF && end - p >= 6 && p[0] == '\\'
+                        && p[1] == 'u' && (lo = hex4(p + 2)) >= 0xDC00 && lo <= 0xDFFF) {
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                    p += 6;
+                }
+                o += encode_utf8(cp, o);
+                break;
+            default:
+                return -1;
+        }
+    }
+    return o - out;
+}
+/*--------------------------------------------------------------------*/
 /* strcmp - assume no strange chars that needs to be stuffed in string... */
 /*--------------------------------------------------------------------*/
 int jsonparse_strcmp_value(struct jsonparse_state *state, const char *str) {
@@ -239,7 +509,7 @@ int jsonparse_strcmp_value(struct jsonparse_state *state, const char *str) {
     return strncmp(str, &state->json[state->vstart], state->vlen);
 }
 /*--------------------------------------------------------------------*/
-int jsonparse_get_len(struct jsonparse_state *state) {
+jsonparse_offset_t jsonparse_get_len(struct jsonparse_state *state) {
     return state->vlen;
 }
 /*--------------------------------------------------------------------*/
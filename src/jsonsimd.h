@@ -0,0 +1,37 @@
+/**
+ * Runtime selection of the vector extensions used by the tokenizer, the
+ * structural indexer and the string writer of dump(). Private to the
+ * library.
+ */
+
+#ifndef SRC_JSONSIMD_H_
+#define SRC_JSONSIMD_H_
+
+#if !defined(JSONPARSE_CONF_NO_SIMD) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define JSONPARSE_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+#ifdef JSONPARSE_SIMD_X86
+enum { SIMD_NONE, SIMD_SSE2, SIMD_AVX2 };
+/* widest vector extension of the running cpu, probed on first use; racing
+   initialisations all store the same value */
+static inline int simd_level(void) {
+    static int level = -1;
+
+    if (level < 0) {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            level = SIMD_AVX2;
+        } else if (__builtin_cpu_supports("sse2")) {
+            level = SIMD_SSE2;
+        } else {
+            level = SIMD_NONE;
+        }
+    }
+    return level;
+}
+#endif
+
+#endif  // SRC_JSONSIMD_H_
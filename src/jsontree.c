@@ -4,6 +4,7 @@
 
 #include <c/jsontree.h>
 #include <c/jsonparse.h>
+#include <c/jsonnumber.h>
 #include <string.h>
 
 #define DEBUG 0
@@ -45,22 +46,12 @@ jsontree_write_string(const struct jsontree_context *js_ctx, const char *text)
 void
 jsontree_write_int(const struct jsontree_context *js_ctx, int value)
 {
-  char buf[10];
-  int l;
+  char buf[JSONNUMBER_FORMAT_INT_MAX];
+  int len, i;
 
-  if(value < 0) {
-    js_ctx->putchar('-');
-    value = -value;
-  }
-
-  l = sizeof(buf) - 1;
-  do {
-    buf[l--] = '0' + (value % 10);
-    value /= 10;
-  } while(value > 0 && l >= 0);
-
-  while(++l < sizeof(buf)) {
-    js_ctx->putchar(buf[l]);
+  len = jsonnumber_format_int32(value, buf);
+  for(i = 0; i < len; i++) {
+    js_ctx->putchar(buf[i]);
   }
 }
 /*---------------------------------------------------------------------------*/
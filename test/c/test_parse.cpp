@@ -1,8 +1,16 @@
 
 #include <gtest/gtest.h>
 #include <c/jsonparse.h>
+#include <c/jsonindex.h>
+#include <c/jsonnumber.h>
+#include <c/jsontree.h>
 #include <cpp/json.hpp>
 #include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <iterator>
 #include <iostream>
 
@@ -153,6 +161,26 @@ TEST(JsonParse, number2){
     EXPECT_EQ(']', jsonparse_next(&state1));
     EXPECT_EQ(0, (jsonparse_next(&state1)));
 }
+TEST(JsonParse, number3){
+    struct jsonparse_state state1;
+    const char* json1 = R"([1e3, -2.5E-3, 0.1e+2, 12345678901])";
+    jsonparse_setup(&state1, json1, strlen(json1));
+
+    EXPECT_EQ(JSON_TYPE_ARRAY, jsonparse_next(&state1));
+    EXPECT_EQ(JSON_TYPE_NUMBER, jsonparse_next(&state1));
+    EXPECT_EQ(1e3, jsonparse_get_value_as_double(&state1));
+    EXPECT_EQ(',', jsonparse_next(&state1));
+    EXPECT_EQ(JSON_TYPE_NUMBER, jsonparse_next(&state1));
+    EXPECT_EQ(-2.5e-3, jsonparse_get_value_as_double(&state1));
+    EXPECT_EQ(',', jsonparse_next(&state1));
+    EXPECT_EQ(JSON_TYPE_NUMBER, jsonparse_next(&state1));
+    EXPECT_EQ(10.0, jsonparse_get_value_as_double(&state1));
+    EXPECT_EQ(',', jsonparse_next(&state1));
+    EXPECT_EQ(JSON_TYPE_NUMBER, jsonparse_next(&state1));
+    EXPECT_EQ(12345678901.0, jsonparse_get_value_as_double(&state1));
+    EXPECT_EQ(']', jsonparse_next(&state1));
+    EXPECT_EQ(0, (jsonparse_next(&state1)));
+}
 TEST(JsonParse, other){
     struct jsonparse_state state1;
     const char* json1 = R"([true, false, null, -1000.1999])";
@@ -174,6 +202,336 @@ TEST(JsonParse, other){
     EXPECT_EQ(0, (jsonparse_next(&state1)));
 }
 
+TEST(JsonParse, emptycontainers){
+    struct jsonparse_state state1;
+    const char* json1 = R"({"a":{},"b":[],"c":1})";
+    jsonparse_setup(&state1, json1, strlen(json1));
+    const int expected[] = { '{', 'N', ':', '{', '}', ',', 'N', ':', '[', ']', ',', 'N', ':', '0', '}' };
+    for (int token : expected) {
+        EXPECT_EQ(token, jsonparse_next(&state1));
+    }
+    EXPECT_EQ(0, state1.depth);
+    EXPECT_EQ(JSON_ERROR_OK, state1.error);
+}
+
+TEST(JsonParse, errors){
+    /* each fails before the end of the input */
+    const char* bad[] = { "]", "{]", "[} ", "{\"a\":} ", "{1} ", "[nul] ", "[-x ", "\"a\"" };
+    const int error[] = {
+        JSON_ERROR_UNEXPECTED_END_OF_ARRAY, JSON_ERROR_UNEXPECTED_END_OF_ARRAY, JSON_ERROR_SYNTAX,
+        JSON_ERROR_SYNTAX, JSON_ERROR_SYNTAX, JSON_ERROR_SYNTAX, JSON_ERROR_SYNTAX,
+        JSON_ERROR_UNEXPECTED_STRING
+    };
+    for (int i = 0; i < 8; ++i) {
+        struct jsonparse_state state1;
+        jsonparse_setup(&state1, bad[i], strlen(bad[i]));
+        while (jsonparse_next(&state1) != JSON_TYPE_ERROR) {}
+        EXPECT_EQ(error[i], state1.error) << bad[i];
+        EXPECT_LE(state1.pos, state1.len) << bad[i];
+    }
+
+    struct jsonparse_state state1;
+    std::string deep(JSONPARSE_MAX_DEPTH + 1, '[');
+    jsonparse_setup(&state1, deep.c_str(), deep.size());
+    while (jsonparse_next(&state1) != JSON_TYPE_ERROR) {}
+    EXPECT_EQ(JSON_ERROR_MAXDEPTH, state1.error);
+    EXPECT_EQ(JSONPARSE_MAX_DEPTH, state1.depth);
+}
+
+TEST(JsonParse, whitespace){
+    /* runs of blanks shorter and longer than a vector block, ending at every
+       offset of the block and right before the end of the buffer */
+    const char ws[] = " \t\r\n";
+    for (int n = 0; n < 80; ++n) {
+        std::string json1 = "[";
+        for (int i = 0; i < n; ++i) json1 += ws[i % 4];
+        json1 += "1,";
+        for (int i = 0; i < n; ++i) json1 += ws[(i + 1) % 4];
+        json1 += "\"a\"";
+        for (int i = 0; i < n; ++i) json1 += ' ';
+        json1 += "]";
+        for (int i = 0; i < n; ++i) json1 += '\n';
+
+        struct jsonparse_state state1;
+        jsonparse_setup(&state1, json1.c_str(), json1.size());
+        EXPECT_EQ(JSON_TYPE_ARRAY, jsonparse_next(&state1));
+        EXPECT_EQ(JSON_TYPE_NUMBER, jsonparse_next(&state1));
+        EXPECT_EQ(n + 1, state1.vstart);
+        EXPECT_EQ(',', jsonparse_next(&state1));
+        EXPECT_EQ(JSON_TYPE_STRING, jsonparse_next(&state1));
+        EXPECT_EQ(1, state1.vlen);
+        EXPECT_EQ(']', jsonparse_next(&state1));
+        EXPECT_EQ(state1.len - n, state1.pos);
+        EXPECT_EQ(0, (jsonparse_next(&state1)));
+        EXPECT_EQ(state1.len + 1, state1.pos);
+    }
+}
+
+TEST(JsonParse, longstring){
+    /* string bodies with escapes at every offset of a vector block, runs of
+       escaped backslashes right before the closing quote */
+    const char* pieces[] = { "a", "\\\"", "\\\\", "\\n", "\\u00e9", "xyz0123456789" };
+    for (int seed = 0; seed < 400; ++seed) {
+        std::string body;
+        unsigned int r = seed * 2654435761u;
+        int count = seed % 40;
+        for (int i = 0; i < count; ++i) {
+            r = r * 1103515245u + 12345u;
+            body += pieces[(r >> 16) % 6];
+        }
+        if (seed % 3 == 0) body += "\\\\";
+        std::string json1 = "[\"" + body + "\", \"" + body + "\"]";
+
+        struct jsonparse_state state1;
+        jsonparse_setup(&state1, json1.c_str(), json1.size());
+        EXPECT_EQ(JSON_TYPE_ARRAY, jsonparse_next(&state1));
+        EXPECT_EQ(JSON_TYPE_STRING, jsonparse_next(&state1));
+        EXPECT_EQ(2, state1.vstart);
+        EXPECT_EQ((int)body.size(), state1.vlen);
+        EXPECT_EQ(',', jsonparse_next(&state1));
+        EXPECT_EQ(JSON_TYPE_STRING, jsonparse_next(&state1));
+        EXPECT_EQ((int)body.size(), state1.vlen);
+        EXPECT_EQ(0, jsonparse_strcmp_value(&state1, body.c_str()));
+        EXPECT_EQ(']', jsonparse_next(&state1));
+    }
+}
+
+TEST(JsonParse, unescape){
+    const char* json1 = R"(a\"b\\c\/\b\f\n\r\t\u00e9\u20AC\ud83d\ude00\ud800x)";
+    char out[64];
+    jsonparse_offset_t n = jsonparse_unescape(json1, strlen(json1), out);
+    const char expected[] = "a\"b\\c/\b\f\n\r\t\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80\xed\xa0\x80x";
+    ASSERT_EQ((int)sizeof(expected) - 1, n);
+    EXPECT_EQ(0, memcmp(expected, out, n));
+
+    /* in place */
+    char buf[] = R"(plain \u0041\n)";
+    n = jsonparse_unescape(buf, strlen(buf), buf);
+    EXPECT_EQ(8, n);
+    EXPECT_EQ(0, memcmp("plain A\n", buf, n));
+
+    const char* bad[] = { "\\", "\\x", "\\u12", "\\u12g4", "abc\\" };
+    for (const char* str : bad) {
+        EXPECT_EQ(-1, (jsonparse_unescape(str, strlen(str), out))) << str;
+    }
+}
+
+TEST(JsonNumber, exact){
+    /* rounding boundaries, subnormals, overflow and more digits than fit
+       into 64 bits; glibc's strtod is correctly rounded */
+    const char* numbers[] = {
+        "0", "-0", "1", "0.1", "1e23", "9007199254740993", "4503599627370497.5",
+        "1.7976931348623157e308", "1.7976931348623159e308", "1e400", "-1e400",
+        "4.9e-324", "2.4703282292062327e-324", "2.4703282292062328e-324", "1e-400",
+        "2.2250738585072011e-308", "2.2250738585072012e-308",
+        "18446744073709551615", "18446744073709551616", "123456789012345678901234567890",
+        "1.00000000000000011102230246251565404236316680908203124",
+        "1.00000000000000011102230246251565404236316680908203125",
+        "1.00000000000000011102230246251565404236316680908203126",
+        "0.0000000000000000000000000000000000000000000000000000000000001e61",
+    };
+    for (const char* text : numbers) {
+        struct jsonnumber num;
+        double expected = strtod(text, NULL);
+        ASSERT_EQ((int)strlen(text), (jsonnumber_parse(text, strlen(text), &num))) << text;
+        EXPECT_EQ(0, memcmp(&expected, &num.value, sizeof(double))) << text;
+    }
+
+    struct jsonnumber num;
+    EXPECT_EQ(20, (jsonnumber_parse("18446744073709551615", 20, &num)));
+    EXPECT_TRUE((num.integer));
+    EXPECT_EQ(UINT64_MAX, num.mantissa);
+    EXPECT_EQ(21, (jsonnumber_parse("-18446744073709551616", 21, &num)));
+    EXPECT_FALSE((num.integer));
+    EXPECT_EQ(2, (jsonnumber_parse("-5", 2, &num)));
+    EXPECT_TRUE((num.integer && num.negative));
+    EXPECT_EQ(5u, num.mantissa);
+    EXPECT_EQ(3, (jsonnumber_parse("5.0", 3, &num)));
+    EXPECT_FALSE((num.integer));
+}
+
+TEST(JsonNumber, grammar){
+    const char* bad[] = { "", "-", "+1", ".5", "1.", "1.e5", "1e", "1e+", "-.5", "x" };
+    for (const char* text : bad) {
+        struct jsonnumber num;
+        EXPECT_EQ(0, (jsonnumber_parse(text, strlen(text), &num))) << text;
+    }
+    /* the number ends where the grammar does, the caller checks the rest */
+    struct jsonnumber num;
+    EXPECT_EQ(1, (jsonnumber_parse("01", 2, &num)));
+    EXPECT_EQ(3, (jsonnumber_parse("1.5.2", 5, &num)));
+    EXPECT_EQ(2, (jsonnumber_parse("12345", 2, &num)));
+    EXPECT_EQ(12.0, num.value);
+}
+
+TEST(JsonNumber, random){
+    unsigned long long r = 88172645463325252ull;
+    for (int i = 0; i < 200000; ++i) {
+        char text[64];
+        double value;
+        r ^= r << 13; r ^= r >> 7; r ^= r << 17;
+        memcpy(&value, &r, sizeof(value));
+        if (value != value || value - value != 0) {
+            continue;
+        }
+        int len = snprintf(text, sizeof text, "%.*e", (int)(r % 20), value);
+        struct jsonnumber num;
+        double expected = strtod(text, NULL);
+        ASSERT_EQ(len, (jsonnumber_parse(text, len, &num))) << text;
+        EXPECT_EQ(0, memcmp(&expected, &num.value, sizeof(double))) << text;
+    }
+}
+
+TEST(JsonNumber, formatInt){
+    char text[JSONNUMBER_FORMAT_INT_MAX + 1];
+    unsigned long long r = 88172645463325252ull;
+    for (int i = 0; i < 200000; ++i) {
+        char expected[32];
+        r ^= r << 13; r ^= r >> 7; r ^= r << 17;
+        const unsigned long long value = r >> (r % 64);
+        text[jsonnumber_format_uint64(value, text)] = '\0';
+        snprintf(expected, sizeof expected, "%llu", value);
+        ASSERT_STREQ(expected, text);
+        text[jsonnumber_format_int64((long long)value, text)] = '\0';
+        snprintf(expected, sizeof expected, "%lld", (long long)value);
+        ASSERT_STREQ(expected, text);
+        text[jsonnumber_format_int32((int)value, text)] = '\0';
+        snprintf(expected, sizeof expected, "%d", (int)value);
+        ASSERT_STREQ(expected, text);
+    }
+    text[jsonnumber_format_int32(0, text)] = '\0';
+    EXPECT_STREQ("0", text);
+    text[jsonnumber_format_int32(INT32_MIN, text)] = '\0';
+    EXPECT_STREQ("-2147483648", text);
+    text[jsonnumber_format_int64(INT64_MIN, text)] = '\0';
+    EXPECT_STREQ("-9223372036854775808", text);
+    text[jsonnumber_format_uint64(UINT64_MAX, text)] = '\0';
+    EXPECT_STREQ("18446744073709551615", text);
+}
+
+TEST(JsonNumber, formatSize){
+    char text[JSONNUMBER_FORMAT_MAX];
+    unsigned long long r = 88172645463325252ull;
+    for (int i = 0; i < 200000; ++i) {
+        double value;
+        r ^= r << 13; r ^= r >> 7; r ^= r << 17;
+        memcpy(&value, &r, sizeof(value));
+        ASSERT_EQ(jsonnumber_format(value, text), jsonnumber_format_size(value)) << value;
+        /* whole numbers, and those just off them */
+        const double whole = (double)(long long)(r >> (r % 64)) * (r & 1 ? -1 : 1);
+        ASSERT_EQ(jsonnumber_format(whole, text), jsonnumber_format_size(whole)) << whole;
+        value = whole + 0.5;
+        ASSERT_EQ(jsonnumber_format(value, text), jsonnumber_format_size(value)) << value;
+        value = whole / 1024;
+        ASSERT_EQ(jsonnumber_format(value, text), jsonnumber_format_size(value)) << value;
+        const unsigned long long bits = r >> (r % 64);
+        ASSERT_EQ(jsonnumber_format_uint64(bits, text), jsonnumber_format_uint64_size(bits));
+        ASSERT_EQ(jsonnumber_format_int64((long long)bits, text), jsonnumber_format_int64_size((long long)bits));
+    }
+    const double edges[] = { 0.0, -0.0, 1e21, 1e20, 9007199254740992.0, 9007199254740991.0,
+                             -9007199254740993.0, 1e-6, 1e-7, 123e-7, 5e-324, 1.7976931348623157e308 };
+    for (double value : edges)
+        EXPECT_EQ(jsonnumber_format(value, text), jsonnumber_format_size(value)) << value;
+    EXPECT_EQ(0, jsonnumber_format_size(HUGE_VAL));
+    EXPECT_EQ(20, jsonnumber_format_int64_size(INT64_MIN));
+}
+
+static std::string tree_output;
+static int tree_putchar(int c) {
+    tree_output += (char)c;
+    return c;
+}
+
+TEST(JsonTree, writeInt){
+    struct jsontree_int value = { JSON_TYPE_INT, 0 };
+    struct jsontree_context ctx;
+    jsontree_setup(&ctx, (struct jsontree_value *)&value, tree_putchar);
+    const int values[] = { 0, 7, -7, 1234567890, INT_MAX, INT_MIN };
+    const char *expected[] = { "0", "7", "-7", "1234567890", "2147483647", "-2147483648" };
+    for (int i = 0; i < 6; ++i) {
+        tree_output.clear();
+        jsontree_write_int(&ctx, values[i]);
+        EXPECT_EQ(expected[i], tree_output);
+    }
+}
+
+TEST(JsonIndex, structurals){
+    const char* json1 = R"({"a\"b": [1, -2.5e3, true], "c":null})";
+    jsonparse_offset_t index[64];
+    jsonparse_offset_t n = jsonindex_build(json1, strlen(json1), index);
+    const int expected[] = { 0, 1, 6, 7, 9, 10, 11, 13, 19, 21, 25, 26, 28, 30, 31, 32, 36 };
+    ASSERT_EQ((int)(sizeof(expected) / sizeof(expected[0])), n);
+    for (int i = 0; i < n; ++i) {
+        EXPECT_EQ(expected[i], index[i]);
+    }
+
+    const char* json2 = R"(["abc)";
+    EXPECT_EQ(-1, (jsonindex_build(json2, strlen(json2), index)));
+}
+
+TEST(JsonIndex, random){
+    /* compare with a byte at a time reference on inputs crossing many
+       64 byte blocks, with backslash runs of every length */
+    const char alphabet[] = "{}[]:,\" \\\\\\a1 \n";
+    for (int seed = 0; seed < 500; ++seed) {
+        unsigned int r = seed * 2654435761u + 1;
+        std::string json1;
+        int len = seed % 300;
+        for (int i = 0; i < len; ++i) {
+            r = r * 1103515245u + 12345u;
+            json1 += alphabet[(r >> 16) % (sizeof(alphabet) - 1)];
+        }
+
+        /* a backslash escapes the next byte anywhere, outside of strings it
+           is a syntax error the second stage reports */
+        std::vector<int> expected;
+        bool in_string = false, escaped = false, scalar = false;
+        for (int i = 0; i < len; ++i) {
+            char c = json1[i];
+            bool quote = c == '"' && !escaped;
+            escaped = !escaped && c == '\\';
+            if (in_string) {
+                if (quote) {
+                    in_string = false;
+                    expected.push_back(i);
+                }
+                continue;
+            }
+            bool ws = strchr(" \t\n\r", c) != NULL;
+            bool op = strchr("{}[]:,", c) != NULL;
+            if (quote) {
+                in_string = true;
+                expected.push_back(i);
+            } else if (op || (!ws && !scalar)) {
+                expected.push_back(i);
+            }
+            scalar = !ws && !op && !quote;
+        }
+
+        std::vector<jsonparse_offset_t> index(len);
+        jsonparse_offset_t n = jsonindex_build(json1.data(), len, index.data());
+        if (in_string) {
+            EXPECT_EQ(-1, n) << json1;
+        } else {
+            ASSERT_EQ((int)expected.size(), n) << json1;
+            EXPECT_TRUE((std::equal(expected.begin(), expected.end(), index.begin()))) << json1;
+        }
+
+        /* the same, one block-sized window at a time */
+        struct jsonindex_state state1;
+        jsonparse_offset_t window[JSONINDEX_BLOCK];
+        std::vector<jsonparse_offset_t> windowed;
+        jsonindex_setup(&state1, json1.data(), len);
+        while ((n = jsonindex_next(&state1, window, JSONINDEX_BLOCK)) > 0) {
+            windowed.insert(windowed.end(), window, window + n);
+        }
+        EXPECT_EQ((in_string ? -1 : 0), n);
+        if (!in_string) {
+            EXPECT_TRUE((windowed == std::vector<jsonparse_offset_t>(expected.begin(), expected.end())));
+        }
+    }
+}
+
 int main(int argc, char* argv[]){
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -1,4 +1,11 @@
+#include <gtest/gtest.h>
 #include <cpp/json.hpp>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <sstream>
 #include <string>
 #include <iostream>
 class Point {
@@ -9,7 +16,7 @@ public:
     xusd::Json to_json() const { return xusd::Json::array { x, y }; }
 };
 
-int main(){
+TEST(JsonDump, object){
     using namespace xusd;
     Json my_json = Json::object {
         { "key1", "value1" },
@@ -17,10 +24,221 @@ int main(){
         { "key3", Json::array { 1, 2, 3 } },
     };
     std::string json_str = my_json.dump();
-    std::cout<<json_str<<std::endl;
+    EXPECT_EQ(R"({"key1": "value1", "key2": false, "key3": [1, 2, 3]})", json_str);
+}
 
+TEST(JsonDump, userType){
+    using namespace xusd;
     std::vector<Point> points = { { 1, 2 }, { 10, 20 }, { 100, 200 } };
     std::string points_json = Json(points).dump();
-    std::cout<<points_json<<std::endl;
-    return 0;
+    EXPECT_EQ("[[1, 2], [10, 20], [100, 200]]", points_json);
+}
+
+TEST(JsonDump, int64){
+    using namespace xusd;
+    Json json = Json::array {
+        std::numeric_limits<int>::min(),
+        std::numeric_limits<int64_t>::min(),
+        std::numeric_limits<int64_t>::max(),
+        std::numeric_limits<uint64_t>::max(),
+        int64_t(0),
+        uint64_t(1700000000123456789u),
+    };
+    EXPECT_EQ("[-2147483648, -9223372036854775808, 9223372036854775807, "
+              "18446744073709551615, 0, 1700000000123456789]", json.dump());
+}
+
+TEST(JsonDump, double){
+    using namespace xusd;
+    Json json = Json::array {
+        0.1, 1.5, -0.0, 100.0, 1e21, 1e-7, 0.000001234,
+        5e-324, 1.7976931348623157e308, -2.2250738585072014e-308,
+        std::numeric_limits<double>::infinity(),
+        std::numeric_limits<double>::quiet_NaN(),
+    };
+    EXPECT_EQ("[0.1, 1.5, -0, 100, 1e+21, 1e-7, 0.000001234, "
+              "5e-324, 1.7976931348623157e+308, -2.2250738585072014e-308, "
+              "null, null]", json.dump());
+
+    // Every double reads back as itself.
+    uint64_t bits = 88172645463325252u;
+    for (int i = 0; i < 100000; ++i) {
+        bits ^= bits << 13;
+        bits ^= bits >> 7;
+        bits ^= bits << 17;
+        double value;
+        memcpy(&value, &bits, sizeof value);
+        if (!std::isfinite(value))
+            continue;
+        const std::string text = Json(Json::array { value }).dump();
+        std::string err;
+        const Json parsed = Json::parse(text, err);
+        ASSERT_TRUE(err.empty()) << text;
+        ASSERT_EQ(value, parsed[0].number_value()) << text;
+    }
+}
+
+// The escaping dump() did one character at a time.
+static std::string escape_reference(const std::string &value) {
+    std::string out = "\"";
+    for (size_t i = 0; i < value.length(); i++) {
+        const char ch = value[i];
+        if (ch == '\\') {
+            out += "\\\\";
+        } else if (ch == '"') {
+            out += "\\\"";
+        } else if (ch == '\b') {
+            out += "\\b";
+        } else if (ch == '\f') {
+            out += "\\f";
+        } else if (ch == '\n') {
+            out += "\\n";
+        } else if (ch == '\r') {
+            out += "\\r";
+        } else if (ch == '\t') {
+            out += "\\t";
+        } else if ((uint8_t)ch <= 0x1f) {
+            char buf[8];
+            snprintf(buf, sizeof buf, "\\u%04x", ch);
+            out += buf;
+        } else if ((uint8_t)ch == 0xe2 && i + 2 < value.length() && (uint8_t)value[i+1] == 0x80
+                   && (uint8_t)value[i+2] == 0xa8) {
+            out += "\\u2028";
+            i += 2;
+        } else if ((uint8_t)ch == 0xe2 && i + 2 < value.length() && (uint8_t)value[i+1] == 0x80
+                   && (uint8_t)value[i+2] == 0xa9) {
+            out += "\\u2029";
+            i += 2;
+        } else {
+            out += ch;
+        }
+    }
+    return out + "\"";
+}
+
+TEST(JsonDump, string){
+    using namespace xusd;
+    EXPECT_EQ("\"a \\\"quoted\\\" \\\\ path\\n\\ttab \\u0001\\u001f \\u2028\\u2029\"",
+              Json("a \"quoted\" \\ path\n\ttab \x01\x1f \xe2\x80\xa8\xe2\x80\xa9").dump());
+    // other characters starting with 0xe2, and one cut short, are copied
+    EXPECT_EQ("\"\xe2\x82\xac \xe2\x80\"", Json("\xe2\x82\xac \xe2\x80").dump());
+
+    // Strings of every length up to a few vector blocks, with the bytes
+    // that need a look at every position.
+    const char alphabet[] = "ab\"\\\n\x01\x1f\xe2\x80\xa8\xa9 \x7f\xff";
+    unsigned int r = 12345;
+    for (int i = 0; i < 20000; ++i) {
+        std::string value;
+        r = r * 1103515245u + 12345u;
+        const size_t len = (r >> 8) % 100;
+        for (size_t j = 0; j < len; ++j) {
+            r = r * 1103515245u + 12345u;
+            // mostly plain text, so clean runs cross block boundaries
+            value += (r >> 8) % 4 ? 'x' : alphabet[(r >> 12) % (sizeof alphabet - 1)];
+        }
+        ASSERT_EQ(escape_reference(value), Json(value).dump());
+    }
+}
+
+TEST(JsonDump, size){
+    using namespace xusd;
+    std::string err;
+    const Json parsed = Json::parse(R"({"a": [1, -2.5, 1e300, true, null, "x\"y\u2028"],
+                                       "b": {}, "c": [], "d": "", "e": 18446744073709551615})", err);
+    const Json built = Json::array { parsed, 0.1, std::numeric_limits<double>::infinity(), "\x01" };
+    for (const Json &json : { parsed, built, Json(), Json(false), Json(-0.0) }) {
+        const std::string text = json.dump();
+        EXPECT_EQ(text.size(), json.dump_size()) << text;
+        // sized again, the strings from what their nodes kept
+        EXPECT_EQ(text.size(), json.dump_size()) << text;
+        EXPECT_EQ(text, json.dump());
+        std::string buffer(json.dump_size(), '*');
+        EXPECT_EQ(&buffer[0] + buffer.size(), json.dump(&buffer[0]));
+        EXPECT_EQ(text, buffer);
+        std::string appended = "> ";
+        json.dump(appended);
+        EXPECT_EQ("> " + text, appended);
+    }
+
+    // Values changed in place are sized anew, and so are the arrays and
+    // objects on the path to them.
+    Json doc = Json::object { { "list", Json::array { 1, 2 } }, { "name", "a" } };
+    EXPECT_EQ(R"({"list": [1, 2], "name": "a"})", doc.dump());
+    doc["list"].push_back("three");
+    doc["name"] = "abc";
+    EXPECT_EQ(R"({"list": [1, 2, "three"], "name": "abc"})", doc.dump());
+    EXPECT_EQ(doc.dump().size(), doc.dump_size());
+    doc["list"].erase(size_t(0));
+    doc.erase("name");
+    EXPECT_EQ(R"({"list": [2, "three"]})", doc.dump());
+    EXPECT_EQ(doc.dump().size(), doc.dump_size());
+
+    // also through a reference held across dumps
+    Json &inner = doc["a"];
+    EXPECT_EQ(R"({"a": null, "list": [2, "three"]})", doc.dump());
+    EXPECT_EQ(doc.dump().size(), doc.dump_size());
+    inner.push_back("a long string");
+    inner.push_back(Json::object { { "x", 1.25 } });
+    const std::string changed = R"({"a": ["a long string", {"x": 1.25}], "list": [2, "three"]})";
+    EXPECT_EQ(changed, doc.dump());
+    EXPECT_EQ(changed.size(), doc.dump_size());
+    std::string buffer(doc.dump_size(), '*');
+    EXPECT_EQ(&buffer[0] + buffer.size(), doc.dump(&buffer[0]));
+    EXPECT_EQ(changed, buffer);
+
+    // the string grows once, to the size of the output
+    const std::string numbers = Json(Json::array(1000, Json(7))).dump();
+    EXPECT_EQ(3000u, numbers.size());
+    EXPECT_GE(numbers.size() + numbers.size() / 8, numbers.capacity());
+}
+
+TEST(JsonDump, dumpTo){
+    using namespace xusd;
+    // larger than the buffer, with a string longer than it
+    Json::array rows;
+    for (int i = 0; i < 20000; ++i)
+        rows.push_back(Json::object { { "id", i }, { "name", "row \"" + std::to_string(i) + "\"" }, { "x", i / 7.0 } });
+    rows.push_back(std::string(200000, 'a') + "\n" + std::string(100000, 'b'));
+    const Json json = rows;
+    const std::string text = json.dump();
+
+    std::string pieces;
+    size_t calls = 0;
+    EXPECT_TRUE(json.dump_to([&](const char *data, size_t size) {
+        pieces.append(data, size);
+        ++calls;
+        return true;
+    }));
+    EXPECT_EQ(text, pieces);
+    EXPECT_LT(1u, calls);
+
+    std::ostringstream stream;
+    EXPECT_TRUE(json.dump_to(stream));
+    EXPECT_EQ(text, stream.str());
+
+    FILE *file = tmpfile();
+    ASSERT_TRUE(file != NULL);
+    EXPECT_TRUE(json.dump_to(file));
+    fflush(file);
+    EXPECT_TRUE(Json(Json::array { 1, "two" }).dump_to(fileno(file)));
+    std::string read(text.size() + 10, '\0');
+    rewind(file);
+    EXPECT_EQ(read.size(), fread(&read[0], 1, read.size(), file));
+    EXPECT_EQ(EOF, fgetc(file));
+    EXPECT_EQ(text + "[1, \"two\"]", read);
+    fclose(file);
+
+    // A failing sink is not called again.
+    calls = 0;
+    EXPECT_FALSE(json.dump_to([&](const char *, size_t) {
+        ++calls;
+        return false;
+    }));
+    EXPECT_EQ(1u, calls);
+    EXPECT_FALSE(json.dump_to(-1));
+}
+
+int main(int argc, char* argv[]){
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
 }
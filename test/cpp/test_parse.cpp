@@ -3,8 +3,16 @@
 #include <c/jsonparse.h>
 #include <cpp/json.hpp>
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <thread>
 #include <iterator>
 #include <iostream>
+#include <memory>
 
 TEST(JsonParse, parsefail){
     const std::string json_str= R"({"name": "xusd-null", "email": "xyz_kankan@126.com", true })";
@@ -121,6 +129,326 @@ TEST(JsonParse, number2){
     EXPECT_EQ((json[2].number_value()), 3.3);
     EXPECT_EQ((json[3].number_value()), -4.4);
 }
+TEST(JsonParse, number3){
+    const std::string json_str = R"([1e3, -2.5E-3, 2147483647, -2147483648, 2147483648, 0.1, 1.7976931348623157e308])";
+    std::string err;
+    xusd::Json json = xusd::Json::parse(json_str, err);
+    EXPECT_TRUE((err.empty()))<<err;
+    EXPECT_EQ((json[0].number_value()), 1e3);
+    EXPECT_EQ((json[1].number_value()), -2.5e-3);
+    EXPECT_EQ((json[2].int_value()), 2147483647);
+    EXPECT_EQ((json[3].int_value()), -2147483647 - 1);
+    EXPECT_EQ((json[4].number_value()), 2147483648.0);
+    EXPECT_EQ((json[5].number_value()), 0.1);
+    EXPECT_EQ((json[6].number_value()), 1.7976931348623157e308);
+
+    const char* bad[] = { "[01]", "[1.]", "[1e]", "[-]", "[1.5.2]", "[1e+-2]", "[--1]" };
+    for (const char* str : bad) {
+        xusd::Json json1 = xusd::Json::parse(str, err);
+        EXPECT_FALSE((err.empty()))<<str;
+        xusd::Json json2 = xusd::Json::parse(str, err, xusd::Json::PARSE_STRUCTURAL_INDEX);
+        EXPECT_FALSE((err.empty()))<<str;
+    }
+}
+
+TEST(JsonParse, int64){
+    const std::string json_str = R"([9007199254740993, -9223372036854775808, 9223372036854775807,
+        18446744073709551615, 18446744073709551616, 1700000000123456789, -2147483649])";
+    std::string err;
+    xusd::Json json = xusd::Json::parse(json_str, err);
+    EXPECT_TRUE((err.empty()))<<err;
+    EXPECT_EQ(9007199254740993, json[0].int64_value());
+    EXPECT_EQ(std::numeric_limits<int64_t>::min(), json[1].int64_value());
+    EXPECT_EQ(std::numeric_limits<int64_t>::max(), json[2].int64_value());
+    EXPECT_EQ(std::numeric_limits<uint64_t>::max(), json[3].uint64_value());
+    EXPECT_EQ(18446744073709551616.0, json[4].number_value());
+    EXPECT_EQ(1700000000123456789u, json[5].uint64_value());
+    EXPECT_EQ(-2147483649, json[6].int64_value());
+    EXPECT_EQ(42, xusd::Json(42).int64_value());
+
+    /* integers compare exactly, even where the doubles are equal */
+    EXPECT_TRUE((json[0] != xusd::Json(int64_t(9007199254740992))));
+    EXPECT_TRUE((xusd::Json(int64_t(9007199254740992)) < json[0]));
+    EXPECT_TRUE((json[1] < json[3]));
+    EXPECT_TRUE((json[3] > json[2]));
+    EXPECT_TRUE((xusd::Json(5) == xusd::Json(uint64_t(5))));
+    EXPECT_TRUE((xusd::Json(-1) < xusd::Json(uint64_t(0))));
+    EXPECT_TRUE((xusd::Json(2.5) < xusd::Json(int64_t(3))));
+
+    xusd::Json json2 = xusd::Json::parse(json.dump(), err);
+    EXPECT_TRUE((json == json2));
+}
+
+TEST(JsonParse, values){
+    /* scalars are stored inline, copies share everything else */
+    EXPECT_LE(sizeof(xusd::Json), 16u);
+    std::string err;
+    const xusd::Json json = xusd::Json::parse(R"([1.5, -7, true, null, "text", [2], {"k": 3}])", err);
+    EXPECT_TRUE((err.empty()))<<err;
+    xusd::Json copy = json;
+    EXPECT_EQ(&json.array_items(), &copy.array_items());
+    EXPECT_EQ(&json[4].string_value(), &copy.array_items()[4].string_value());
+    xusd::Json moved = std::move(copy);
+    EXPECT_TRUE((copy.is_null()));
+    EXPECT_TRUE((moved == json));
+
+    EXPECT_EQ(1.5, json[0].number_value());
+    EXPECT_EQ(1, json[0].int_value());
+    EXPECT_EQ(-7, json[1].int_value());
+    EXPECT_EQ(-7.0, json[1].number_value());
+    EXPECT_TRUE((json[2].bool_value()));
+    EXPECT_TRUE((json[3].is_null()));
+    EXPECT_EQ(0, json[4].int_value());
+    EXPECT_FALSE((json[1].bool_value()));
+    EXPECT_TRUE((json[1]["k"].is_null()));
+    EXPECT_TRUE((json[0][0].is_null()));
+    EXPECT_EQ(3, json[6]["k"].int_value());
+
+    moved = moved;
+    EXPECT_EQ("text", moved[4].string_value());
+    moved = json[5];
+    EXPECT_EQ(2, moved[0].int_value());
+    EXPECT_TRUE((xusd::Json(false) < xusd::Json(true)));
+    EXPECT_TRUE((xusd::Json() == xusd::Json(nullptr)));
+    EXPECT_TRUE((xusd::Json(-7) == json[1]));
+    EXPECT_TRUE((xusd::Json(-7.0) == json[1]));
+    EXPECT_EQ("[1.5, -7, true, null, \"text\", [2], {\"k\": 3}]", json.dump());
+
+    /* empty strings, arrays and objects share one node each */
+    const xusd::Json empties = xusd::Json::parse(R"(["", [], {}, "", [], {}])", err);
+    EXPECT_EQ(&empties[0].string_value(), &empties[3].string_value());
+    EXPECT_EQ(&empties[1].array_items(), &empties[4].array_items());
+    EXPECT_EQ(&empties[2].object_items(), &empties[5].object_items());
+    EXPECT_EQ(&empties[0].string_value(), &xusd::Json("").string_value());
+    EXPECT_EQ(&empties[1].array_items(), &xusd::Json(xusd::Json::array()).array_items());
+    EXPECT_EQ(&empties[2].object_items(), &xusd::Json(xusd::Json::object()).object_items());
+    xusd::Json filled = empties;
+    filled[1].push_back(1);
+    filled[2].set("k", 2);
+    EXPECT_EQ(R"(["", [1], {"k": 2}, "", [], {}])", filled.dump());
+    EXPECT_EQ(R"(["", [], {}, "", [], {}])", empties.dump());
+    const xusd::Json indexed = xusd::Json::parse(R"(["", [], {}])", err, xusd::Json::PARSE_STRUCTURAL_INDEX);
+    EXPECT_EQ(&empties[0].string_value(), &indexed[0].string_value());
+    EXPECT_EQ(&empties[1].array_items(), &indexed[1].array_items());
+    EXPECT_EQ(&empties[2].object_items(), &indexed[2].object_items());
+}
+
+TEST(JsonParse, objects){
+    std::string err;
+    xusd::Json json = xusd::Json::parse(R"({"b": 1, "a": 2, "c": 3, "a": 4})", err);
+    EXPECT_TRUE((err.empty()))<<err;
+    const xusd::Json::object &members = json.object_items();
+    EXPECT_EQ(3u, members.size());
+    EXPECT_EQ("a", members.begin()->first);
+    EXPECT_EQ(4, json["a"].int_value());
+    EXPECT_EQ(1u, members.count("b"));
+    EXPECT_EQ(0u, members.count("d"));
+    EXPECT_TRUE((members.find("d") == members.end()));
+    EXPECT_EQ(3, members.at("c").int_value());
+    EXPECT_THROW(members.at("d"), std::out_of_range);
+    EXPECT_EQ(R"({"a": 4, "b": 1, "c": 3})", json.dump());
+
+    /* larger objects are searched by binary search */
+    std::string large = "{";
+    for (int i = 99; i >= 0; --i)
+        large += "\"key" + std::to_string(i) + "\": " + std::to_string(i) + (i ? ", " : "}");
+    for (int options : { (int)xusd::Json::PARSE_DEFAULT, (int)xusd::Json::PARSE_STRUCTURAL_INDEX }) {
+        err.clear();
+        const xusd::Json big = xusd::Json::parse(large, err, options);
+        EXPECT_TRUE((err.empty()))<<err;
+        EXPECT_EQ(100u, big.object_items().size());
+        for (int i = 0; i < 100; ++i)
+            EXPECT_EQ(i, big["key" + std::to_string(i)].int_value());
+        EXPECT_TRUE((big["key100"].is_null()));
+        EXPECT_TRUE((std::is_sorted(big.object_items().begin(), big.object_items().end())));
+    }
+
+    /* like std::map: the first of repeated keys, insert and erase */
+    xusd::Json::object built { { "x", 1 }, { "y", 2 }, { "x", 3 } };
+    EXPECT_EQ(1, built.at("x").int_value());
+    EXPECT_FALSE((built.insert({ "y", 5 }).second));
+    EXPECT_TRUE((built.insert({ "w", 5 }).second));
+    built["z"] = "new";
+    EXPECT_EQ(1u, built.erase("x"));
+    EXPECT_EQ(0u, built.erase("x"));
+    EXPECT_EQ(R"({"w": 5, "y": 2, "z": "new"})", xusd::Json(built).dump());
+
+    std::map<std::string, int> ordered { { "k2", 2 }, { "k1", 1 } };
+    EXPECT_TRUE((xusd::Json(ordered) == xusd::Json::parse(R"({"k1": 1, "k2": 2})", err)));
+}
+
+TEST(JsonParse, modify){
+    std::string err;
+    const xusd::Json config = xusd::Json::parse(
+        R"({"server": {"port": 80, "hosts": ["a", "b"]}, "log": {"level": "info"}})", err);
+    EXPECT_TRUE((err.empty()))<<err;
+
+    /* a copy is changed along the path, the rest stays shared */
+    xusd::Json changed = config;
+    changed["server"]["port"] = 8080;
+    changed["server"]["hosts"].push_back("c");
+    changed.set("debug", true);
+    EXPECT_EQ(80, config["server"]["port"].int_value());
+    EXPECT_EQ(2u, config["server"]["hosts"].array_items().size());
+    EXPECT_TRUE((config["debug"].is_null()));
+    EXPECT_EQ(R"({"debug": true, "log": {"level": "info"}, "server": {"hosts": ["a", "b", "c"], "port": 8080}})",
+              changed.dump());
+    const xusd::Json &log = changed["log"];
+    EXPECT_EQ(&config["log"].object_items(), &log.object_items());
+
+    /* a value no one else refers to is changed in place */
+    const xusd::Json::object *members = &changed.object_items();
+    changed["log"]["level"] = "debug";
+    EXPECT_EQ(1u, changed.erase("debug"));
+    EXPECT_EQ(0u, changed.erase("debug"));
+    EXPECT_EQ(members, &changed.object_items());
+    EXPECT_EQ("info", config["log"]["level"].string_value());
+    EXPECT_EQ("debug", changed["log"]["level"].string_value());
+
+    /* null becomes an array or object, arrays grow with nulls */
+    xusd::Json built;
+    built["list"][2] = 3;
+    built["list"].erase(0);
+    built["list"].erase(5);
+    built["empty"].push_back(nullptr);
+    built["empty"].erase(0);
+    EXPECT_EQ(R"({"empty": [], "list": [null, 3]})", built.dump());
+    EXPECT_THROW(built["list"]["key"], std::domain_error);
+    EXPECT_THROW(built["list"][1].push_back(1), std::domain_error);
+}
+
+TEST(JsonParse, largeObjects){
+    /* lookups go through the hash index, from several threads at once */
+    std::string doc = "{";
+    for (int i = 0; i < 5000; ++i)
+        doc += (i ? ", \"id" : "\"id") + std::to_string(i * 7919 % 5000) + "\": " + std::to_string(i * 7919 % 5000);
+    doc += "}";
+    std::string err;
+    const xusd::Json json = xusd::Json::parse(doc, err);
+    EXPECT_TRUE((err.empty()))<<err;
+    std::vector<std::thread> threads;
+    std::atomic<int> found(0);
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 5000; ++i)
+                found += json["id" + std::to_string(i)].int_value() == i;
+            found -= !json["id5000"].is_null() + !json["id-1"].is_null();
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    EXPECT_EQ(4 * 5000, found.load());
+
+    /* copies and changes keep the index right */
+    xusd::Json::object members = json.object_items();
+    EXPECT_EQ(1u, members.erase("id42"));
+    EXPECT_TRUE((members.find("id42") == members.end()));
+    members["id42a"] = 1;
+    EXPECT_TRUE((members.insert({ "id9999", 2 }).second));
+    EXPECT_EQ(1, members.at("id42a").int_value());
+    EXPECT_EQ(2, members.at("id9999").int_value());
+    EXPECT_EQ(4999, members.at("id4999").int_value());
+    xusd::Json::object moved = std::move(members);
+    EXPECT_EQ(5001u, moved.size());
+    EXPECT_EQ(17, moved.at("id17").int_value());
+    moved = json.object_items();
+    EXPECT_EQ(42, moved.at("id42").int_value());
+    moved.clear();
+    EXPECT_EQ(0u, moved.count("id42"));
+
+    /* members added and taken out one at a time, looked up in between */
+    xusd::Json::object grown;
+    for (int i = 0; i < 400; ++i) {
+        grown["k" + std::to_string(i * 37 % 400)] = i;
+        ASSERT_EQ(i, grown.at("k" + std::to_string(i * 37 % 400)).int_value());
+        if (i % 3 == 2) {
+            ASSERT_EQ(1u, grown.erase("k" + std::to_string((i - 1) * 37 % 400)));
+            ASSERT_EQ(0u, grown.count("k" + std::to_string((i - 1) * 37 % 400)));
+        }
+    }
+    EXPECT_EQ(400u - 133u, grown.size());
+    for (int i = 0; i < 400; ++i)
+        EXPECT_EQ(i % 3 != 1, grown.count("k" + std::to_string(i * 37 % 400)) == 1) << i;
+    for (int i = 0; i < 400; ++i) {
+        if (i % 3 == 1)
+            continue;
+        ASSERT_EQ(1u, grown.erase("k" + std::to_string(i * 37 % 400)));
+        for (int j = i + 1; j < 400; ++j)
+            ASSERT_EQ(j % 3 != 1, grown.count("k" + std::to_string(j * 37 % 400)) == 1) << i << " " << j;
+    }
+    EXPECT_TRUE(grown.empty());
+}
+
+TEST(JsonParse, internKeys){
+    const std::string record = R"({"name": "a", "a_rather_long_key_name": 1})";
+    std::string err;
+    xusd::Json first = xusd::Json::parse(record, err, xusd::Json::PARSE_INTERN_KEYS);
+    xusd::Json second = xusd::Json::parse(record, err, xusd::Json::PARSE_INTERN_KEYS);
+    xusd::Json other = xusd::Json::parse(record, err);
+    EXPECT_TRUE((err.empty()))<<err;
+    /* long keys are shared across documents with the option */
+    const xusd::object_key &key = first.object_items().begin()->first;
+    EXPECT_EQ(key.data(), second.object_items().begin()->first.data());
+    EXPECT_NE(key.data(), other.object_items().begin()->first.data());
+    EXPECT_TRUE((key == other.object_items().begin()->first));
+    EXPECT_TRUE((first == other));
+    EXPECT_EQ(R"({"a_rather_long_key_name": 1, "name": "a"})", first.dump());
+
+    /* keys read like std::string */
+    EXPECT_EQ("a_rather_long_key_name", key);
+    EXPECT_TRUE((key == std::string("a_rather_long_key_name")));
+    EXPECT_TRUE((key != xusd::string_view("name")));
+    std::string text = key;
+    EXPECT_EQ(22u, text.size());
+    EXPECT_EQ(22u, key.size());
+    EXPECT_STREQ("a_rather_long_key_name", key.c_str());
+    EXPECT_EQ(xusd::object_key("a_rather_long_key_name").hash(), key.hash());
+    const xusd::object_key name = second.object_items().rbegin()->first;
+    EXPECT_EQ("name", name);
+    EXPECT_STREQ("name", name.c_str());
+    EXPECT_EQ(xusd::object_key(std::string("name")).hash(), name.hash());
+    EXPECT_TRUE((xusd::object_key("fifteen_bytes__") < xusd::object_key("sixteen_bytes___")));
+    EXPECT_FALSE((xusd::object_key("fifteen_bytes__") == xusd::object_key("fifteen_bytes_")));
+    EXPECT_TRUE((xusd::object_key().empty()));
+    EXPECT_TRUE((xusd::object_key() == ""));
+
+    /* interned keys may be released on other threads */
+    std::vector<xusd::Json> parsed(4);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&parsed, t] {
+            std::string thread_err;
+            for (int i = 0; i < 100; ++i)
+                parsed[t] = xusd::Json::parse(R"({"k": [{"k": 1}, {"k": 2}]})", thread_err,
+                                              xusd::Json::PARSE_INTERN_KEYS);
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+    for (const xusd::Json &json : parsed)
+        EXPECT_EQ(2, json["k"][1]["k"].int_value());
+}
+
+TEST(JsonParse, shortStrings){
+    std::string json_str = "[";
+    for (int i = 0; i < 200; ++i)
+        json_str += std::string(i ? "," : "") + R"(["NL", "EUR", "x\n", "a string longer than 15"])";
+    json_str += "]";
+    std::string err;
+    xusd::Json json = xusd::Json::parse(json_str, err);
+    EXPECT_TRUE((err.empty()))<<err;
+    /* repeated short strings of a large document share their node */
+    const xusd::Json &first = json[199];
+    const xusd::Json &second = json[198];
+    EXPECT_EQ(first[0].string_view_value().data(), second[0].string_view_value().data());
+    EXPECT_EQ(first[1].string_view_value().data(), second[1].string_view_value().data());
+    EXPECT_NE(first[3].string_view_value().data(), second[3].string_view_value().data());
+    EXPECT_EQ("NL", json[0][0].string_value());
+    EXPECT_EQ("x\n", first[2].string_value());
+    EXPECT_EQ("a string longer than 15", first[3].string_value());
+    EXPECT_TRUE((json[0] == first));
+}
+
 TEST(JsonParse, other){
     const std::string json_str = R"([true, false, null, -1000.1999])";
     std::string err;
@@ -136,6 +464,322 @@ TEST(JsonParse, other){
     EXPECT_EQ((json[3].number_value()), -1000.1999);
 }
 
+TEST(JsonParse, nested){
+    const std::string json_str = R"([[1, 2], {"a": {}, "b": [], "c": [[]]}, [{"d": 3}, {"e": 4}], 5])";
+    std::string err;
+    xusd::Json json = xusd::Json::parse(json_str, err);
+    EXPECT_TRUE((err.empty()))<<err;
+    EXPECT_EQ(4u, json.array_items().size());
+    EXPECT_EQ(2, json[0][1].int_value());
+    EXPECT_TRUE((json[1]["a"].is_object()));
+    EXPECT_TRUE((json[1]["b"].is_array()));
+    EXPECT_TRUE((json[1]["c"][0].is_array()));
+    EXPECT_EQ(4, json[2][1]["e"].int_value());
+    EXPECT_EQ(5, json[3].int_value());
+}
+
+TEST(JsonParse, maxdepth){
+    std::string err;
+    xusd::Json json = xusd::Json::parse(std::string(1000, '['), err);
+    EXPECT_FALSE((err.empty()));
+}
+
+TEST(JsonParse, escapes){
+    const std::string json_str = R"({"a\tb": "x\"y\u00e9\ud83d\ude00", "c": ["\\", "\n"]})";
+    for (int options : { xusd::Json::PARSE_DEFAULT, xusd::Json::PARSE_STRUCTURAL_INDEX }) {
+        std::string err;
+        xusd::Json json = xusd::Json::parse(json_str, err, options);
+        EXPECT_TRUE((err.empty()))<<err;
+        EXPECT_EQ("x\"y\xc3\xa9\xf0\x9f\x98\x80", json["a\tb"].string_value());
+        EXPECT_EQ("\\", json["c"][0].string_value());
+        EXPECT_EQ("\n", json["c"][1].string_value());
+
+        xusd::Json json2 = xusd::Json::parse(R"(["\q"])", err, options);
+        EXPECT_FALSE((err.empty()));
+        xusd::Json json3 = xusd::Json::parse(R"({"\u12": 1})", err, options);
+        EXPECT_FALSE((err.empty()));
+    }
+}
+
+TEST(JsonParse, insitu){
+    const std::string json_str = R"({"name": "a\"b", "list": ["\u20ac", "plain", {"k\n": "v"}]})";
+    std::string err;
+    xusd::Json copied = xusd::Json::parse(json_str, err);
+    for (int options : { xusd::Json::PARSE_DEFAULT, xusd::Json::PARSE_STRUCTURAL_INDEX }) {
+        std::vector<char> buffer(json_str.begin(), json_str.end());
+        buffer.push_back(0);
+        xusd::Json json = xusd::Json::parse_insitu(buffer.data(), err, options);
+        EXPECT_TRUE((err.empty()))<<err;
+        EXPECT_TRUE((json == copied));
+
+        /* strings refer to the decoded bytes in the buffer */
+        xusd::string_view name = json["name"].string_view_value();
+        EXPECT_TRUE((name == "a\"b"));
+        EXPECT_GE(name.data(), buffer.data());
+        EXPECT_LT(name.data(), buffer.data() + buffer.size());
+        EXPECT_TRUE((json["list"][0].string_view_value() == "\xe2\x82\xac"));
+        EXPECT_EQ("plain", json["list"][1].string_value());
+        EXPECT_EQ("v", json["list"][2]["k\n"].string_value());
+        EXPECT_EQ(copied.dump(), json.dump());
+    }
+
+    char bad[] = R"(["\x"])";
+    xusd::Json json = xusd::Json::parse_insitu(bad, err);
+    EXPECT_FALSE((err.empty()));
+    EXPECT_TRUE((json.is_null()));
+}
+
+TEST(JsonParse, borrowed){
+    std::string err;
+    std::shared_ptr<std::string> text = std::make_shared<std::string>(
+        R"({"name": "a string too long to be stored inline", "list": ["an escaped \"string\" of some length", "short", {"k": "\u20ac"}]})");
+    xusd::Json copied = xusd::Json::parse(*text, err);
+    for (int options : { xusd::Json::PARSE_DEFAULT, xusd::Json::PARSE_STRUCTURAL_INDEX }) {
+        xusd::Json json = xusd::Json::parse_borrowed(text, err, options);
+        EXPECT_TRUE((err.empty()))<<err;
+        EXPECT_TRUE((json == copied));
+
+        /* long strings without escapes point into the text, the rest are
+           copies */
+        const char* begin = text->data();
+        const char* end = text->data() + text->size();
+        xusd::string_view name = json["name"].string_view_value();
+        EXPECT_TRUE((name == "a string too long to be stored inline"));
+        EXPECT_TRUE((name.data() >= begin && name.data() < end));
+        xusd::string_view escaped = json["list"][0].string_view_value();
+        EXPECT_TRUE((escaped == "an escaped \"string\" of some length"));
+        EXPECT_TRUE((escaped.data() < begin || escaped.data() >= end));
+        EXPECT_EQ("short", json["list"][1].string_value());
+    }
+
+    /* the result keeps the text alive */
+    xusd::Json json = xusd::Json::parse_borrowed(text, err);
+    std::weak_ptr<std::string> weak = text;
+    text.reset();
+    EXPECT_FALSE((weak.expired()));
+    EXPECT_EQ("a string too long to be stored inline", json["name"].string_value());
+    json = xusd::Json();
+    EXPECT_TRUE((weak.expired()));
+}
+
+TEST(JsonParse, owned){
+    const std::string json_str =
+        R"({"name": "a string too long to be stored inline", "list": ["an \"escaped\" string of some length", "short"]})";
+    std::string err;
+    xusd::Json copied = xusd::Json::parse(json_str, err);
+    for (int options : { xusd::Json::PARSE_DEFAULT, xusd::Json::PARSE_STRUCTURAL_INDEX }) {
+        /* strings refer to the buffer the result took over, escaped ones
+           decoded in it */
+        std::string text = json_str;
+        const char* begin = text.data();
+        const char* end = text.data() + text.size();
+        xusd::Json json = xusd::Json::parse(std::move(text), err, options);
+        EXPECT_TRUE((err.empty()))<<err;
+        EXPECT_TRUE((json == copied));
+        xusd::string_view name = json["name"].string_view_value();
+        EXPECT_TRUE((name.data() >= begin && name.data() < end));
+        xusd::string_view escaped = json["list"][0].string_view_value();
+        EXPECT_TRUE((escaped == "an \"escaped\" string of some length"));
+        EXPECT_TRUE((escaped.data() >= begin && escaped.data() < end));
+        EXPECT_EQ("short", json["list"][1].string_value());
+
+        std::unique_ptr<char[]> buffer(new char[json_str.size() + 1]);
+        std::copy(json_str.begin(), json_str.end(), buffer.get());
+        buffer[json_str.size()] = 0;
+        begin = buffer.get();
+        json = xusd::Json::parse(std::move(buffer), json_str.size(), err, options);
+        EXPECT_TRUE((err.empty()))<<err;
+        EXPECT_TRUE((json == copied));
+        escaped = json["list"][0].string_view_value();
+        EXPECT_TRUE((escaped.data() >= begin && escaped.data() < begin + json_str.size()));
+    }
+
+    /* strings keep the buffer alive */
+    xusd::Json name = xusd::Json::parse(std::string(json_str), err)["name"];
+    EXPECT_EQ("a string too long to be stored inline", name.string_value());
+    EXPECT_TRUE((xusd::Json::parse(std::unique_ptr<char[]>(), 0, err).is_null()));
+    EXPECT_EQ("null input", err);
+}
+
+TEST(JsonParse, truncated){
+    /* text that ends inside a string or number is read no further than
+       the zero behind it */
+    for (const char* json_str : { "\"abc\\", "[\"abc\\", "{\"abc\\", "[\"abc\\\\", "[\"", "[1, 2.5e" }) {
+        const size_t len = strlen(json_str);
+        for (int options : { xusd::Json::PARSE_DEFAULT, xusd::Json::PARSE_STRUCTURAL_INDEX }) {
+            std::string err;
+            std::unique_ptr<char[]> buffer(new char[len + 1]);
+            std::copy(json_str, json_str + len + 1, buffer.get());
+            EXPECT_TRUE((xusd::Json::parse(std::move(buffer), len, err, options).is_null()));
+            EXPECT_FALSE((err.empty()))<<json_str;
+            err.clear();
+            EXPECT_TRUE((xusd::Json::parse(std::string(json_str), err, options).is_null()));
+            EXPECT_FALSE((err.empty()))<<json_str;
+        }
+    }
+}
+
+TEST(JsonParse, arena){
+    const std::string json_str = R"({"name": "a string too long to be stored inline", "id": 9007199254740993,
+        "list": ["a\"b", 2.5, -3, true, null, {"k": "\u20ac"}, []]})";
+    std::string err;
+    xusd::Json copied = xusd::Json::parse(json_str, err);
+    xusd::Json sub;
+    for (int options : { (int)xusd::Json::PARSE_ARENA,
+                         xusd::Json::PARSE_ARENA | xusd::Json::PARSE_STRUCTURAL_INDEX }) {
+        err.clear();
+        xusd::Json json = xusd::Json::parse(json_str, err, options);
+        EXPECT_TRUE((err.empty()))<<err;
+        EXPECT_TRUE((json == copied));
+        EXPECT_EQ(copied.dump(), json.dump());
+        sub = json["list"];
+
+        std::vector<char> buffer(json_str.begin(), json_str.end());
+        buffer.push_back(0);
+        EXPECT_TRUE((xusd::Json::parse_insitu(buffer.data(), err, options) == copied));
+        std::shared_ptr<const std::string> text = std::make_shared<std::string>(json_str);
+        EXPECT_TRUE((xusd::Json::parse_borrowed(text, err, options) == copied));
+
+        xusd::Json bad = xusd::Json::parse(R"({"a": ["b", 1, "\x"]})", err, options);
+        EXPECT_FALSE((err.empty()));
+    }
+    /* nodes keep the arena alive after the root is gone */
+    EXPECT_TRUE((sub == copied["list"]));
+    EXPECT_EQ("a\"b", sub[0].string_value());
+}
+
+TEST(JsonParse, structuralIndex){
+    const std::string json_str = R"({
+        "core": { "editor": "vim", "quotepath":false },
+            "user":{ "name":"null" , "email":"xyz_kankan@126.com" },
+            "alias":{
+                "hist":"log --pretty=format:\"%h %ad | %s%d [%an]\" --graph --date=short",
+                "dump":"cat-file -p"
+            },
+            "list": [1, 2.5, -3, [], {}, [true, false, null], "\\"],
+            "empty": {}
+    })";
+    std::string err1, err2;
+    xusd::Json json1 = xusd::Json::parse(json_str, err1);
+    xusd::Json json2 = xusd::Json::parse(json_str, err2, xusd::Json::PARSE_STRUCTURAL_INDEX);
+    EXPECT_TRUE((err2.empty()))<<err2;
+    EXPECT_TRUE((json2.is_object()));
+    EXPECT_EQ("vim", json2["core"]["editor"].string_value());
+    EXPECT_EQ(-3, json2["list"][2].int_value());
+    EXPECT_EQ(2.5, json2["list"][1].number_value());
+    EXPECT_TRUE((json2["list"][4].is_object()));
+    EXPECT_TRUE((json2["list"][5][2].is_null()));
+    EXPECT_TRUE((json2["empty"].is_object()));
+    EXPECT_TRUE((err1.empty()))<<err1;
+    EXPECT_TRUE((json1 == json2));
+}
+
+TEST(JsonParse, structuralIndexFail){
+    const char* bad[] = {
+        R"({"name": "xusd-null", "email": "xyz_kankan@126.com", true })",
+        R"({"a": 1 "b": 2})",
+        R"([1, 2)",
+        R"(["abc)",
+        R"([tru])",
+        R"([1x])",
+        R"({"a" 1})",
+        R"({"a": 1,, "b": 2})",
+        R"({, "a": 1})",
+        R"({"a": 1true})",
+        R"(1)",
+        R"("s")",
+        R"(true)",
+    };
+    for (const char* json_str : bad) {
+        for (int options : { xusd::Json::PARSE_DEFAULT, xusd::Json::PARSE_STRUCTURAL_INDEX }) {
+            std::string err;
+            xusd::Json json = xusd::Json::parse(json_str, err, options);
+            EXPECT_FALSE((err.empty()))<<json_str;
+            EXPECT_TRUE((json.is_null()));
+        }
+    }
+}
+
+TEST(JsonParse, structuralIndexLax){
+    /* both backends take the separators jsonparse_next() lets through */
+    const char* lax[][2] = {
+        { R"([1 2])", R"([1, 2])" },
+        { R"([1,])", R"([1])" },
+        { R"([,1])", R"([1])" },
+        { R"([1,,2])", R"([1, 2])" },
+        { R"([null,])", R"([null])" },
+        { R"(["a" "b"])", R"(["a", "b"])" },
+        { R"({"a":1,})", R"({"a": 1})" },
+        { R"([truefalse, 1true, null1, 1"a"])", R"([true, false, 1, true, null, 1, 1, "a"])" },
+        { R"([[1 ,, 2], {"b": []},] trailing)", R"([[1, 2], {"b": []}])" },
+    };
+    for (const auto &test : lax) {
+        for (int options : { xusd::Json::PARSE_DEFAULT, xusd::Json::PARSE_STRUCTURAL_INDEX }) {
+            std::string err;
+            xusd::Json json = xusd::Json::parse(test[0], err, options);
+            EXPECT_TRUE((err.empty()))<<test[0]<<err;
+            EXPECT_EQ(test[1], json.dump());
+        }
+    }
+
+    /* a ':' outside of a pair is a null to the default parser only */
+    for (const char* json_str : { "[1, :2, 3]", ":" }) {
+        std::string err1, err2;
+        xusd::Json::parse(json_str, err1);
+        xusd::Json::parse(json_str, err2, xusd::Json::PARSE_STRUCTURAL_INDEX);
+        EXPECT_TRUE((err1.empty()))<<json_str;
+        EXPECT_FALSE((err2.empty()))<<json_str;
+    }
+}
+
+TEST(JsonParse, document){
+    const std::string json_str = R"({"name": "tape", "list": [1, -2, 2.5, 18446744073709551615, true, null, "a\nb", -9223372036854775808],
+                                     "nested": {"k": {"k": []}}, "name": "last", "empty": {}})";
+    std::string err;
+    const xusd::JsonDocument doc = xusd::JsonDocument::parse(json_str, err);
+    EXPECT_TRUE((err.empty()))<<err;
+    const xusd::JsonElement root = doc.root();
+    EXPECT_TRUE((root.is_object()));
+    EXPECT_EQ(5u, root.size());
+    EXPECT_EQ("last", root["name"].string_value());
+    const xusd::JsonElement list = root["list"];
+    EXPECT_EQ(8u, list.size());
+    EXPECT_EQ(1, list[0].int_value());
+    EXPECT_EQ(-2, list[1].int64_value());
+    EXPECT_EQ(2.5, list[2].number_value());
+    EXPECT_EQ(18446744073709551615ull, list[3].uint64_value());
+    EXPECT_TRUE((list[4].bool_value()));
+    EXPECT_TRUE((list[5].is_null()));
+    EXPECT_EQ("a\nb", list[6].string_view_value().to_string());
+    EXPECT_EQ(INT64_MIN, list[7].int64_value());
+    EXPECT_TRUE((list[8].is_null()));
+    EXPECT_TRUE((root["missing"].is_null()));
+    EXPECT_TRUE((root["nested"]["k"]["k"].is_array()));
+    EXPECT_EQ(0u, root["empty"].size());
+    EXPECT_TRUE((root["empty"].begin() == root["empty"].end()));
+
+    /* members in document order */
+    std::string keys;
+    for (xusd::JsonElement::iterator it = root.begin(); it != root.end(); ++it)
+        keys += it.key().to_string() + ":" + std::to_string((*it).type()) + ",";
+    EXPECT_EQ("name:3,list:4,nested:5,name:3,empty:5,", keys);
+    double sum = 0;
+    for (const xusd::JsonElement &item : list)
+        sum += item.number_value();
+    EXPECT_EQ(1 - 2 + 2.5 + 18446744073709551615.0 - 9223372036854775808.0, sum);
+
+    /* converts to the tree Json::parse() makes */
+    EXPECT_TRUE((doc.to_json() == xusd::Json::parse(json_str, err)));
+    xusd::Json nested = root["nested"];
+    EXPECT_EQ(R"({"k": {"k": []}})", nested.dump());
+
+    const char* bad[] = { R"({"a": 1 "b": 2})", R"([1, 2)", R"(["a\x"])", R"([1x])" };
+    for (const char* bad_str : bad) {
+        err.clear();
+        EXPECT_TRUE((xusd::JsonDocument::parse(bad_str, err).root().is_null()));
+        EXPECT_FALSE((err.empty()))<<bad_str;
+    }
+}
 
 int main(int argc, char* argv[]){
     ::testing::InitGoogleTest(&argc, argv);